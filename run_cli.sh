@@ -3,4 +3,4 @@ set -e
 cd build
 cmake --build .
 cd ..
-build/cli --bible_reading_plans_path=/home/jryu/bible-reading-calendar/bible-reading-plans/
+build/cli --bible_reading_plans_path=/home/jryu/bible-reading-calendar/bible-reading-plans/ --bible_reading_plan_pack=build/bible-reading-plans.pack
@@ -8,4 +8,4 @@ cd ..
 ulimit -c unlimited
 rm -f core
 
-build/bible-reading-calendar --undefok=c --bible_reading_plans_path=/home/jryu/bible-reading-calendar/bible-reading-plans/ -c src/conf-dev.js
+build/bible-reading-calendar --undefok=c --bible_reading_plans_path=/home/jryu/bible-reading-calendar/bible-reading-plans/ --bible_reading_plan_pack=build/bible-reading-plans.pack -c src/conf-dev.js
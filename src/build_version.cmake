@@ -0,0 +1,16 @@
+# Writes OUTPUT, a header defining kBuildVersion as a hash of SOURCES, the
+# "|"-separated files under SOURCE_DIR that decide what is rendered. Run on
+# every build that changes one of them, so unlike __DATE__ and __TIME__ of a
+# single file, the version follows every change of the rendering code.
+string(REPLACE "|" ";" SOURCES "${SOURCES}")
+set(hashes "")
+foreach(source ${SOURCES})
+  file(SHA256 ${SOURCE_DIR}/${source} hash)
+  string(APPEND hashes ${hash})
+endforeach()
+string(SHA256 version "${hashes}")
+string(SUBSTRING ${version} 0 16 version)
+
+file(WRITE ${OUTPUT}
+  "// Generated by build_version.cmake.\n"
+  "const char kBuildVersion[] = \"${version}\";\n")
@@ -1,15 +1,18 @@
+#include <algorithm>
 #include <cairo.h>
 #include <cairo-pdf.h>
 #include <cairo-svg.h>
+#include <cmath>
 #include <fcntl.h>
 #include <fstream>
 #include <gflags/gflags.h>
 #include <google/protobuf/io/zero_copy_stream_impl.h>
 #include <google/protobuf/text_format.h>
+#include <future>
 #include <iomanip>
 #include <iostream>
+#include <limits.h>
 #include <librsvg/rsvg.h>
-#include <list>
 #include <pango/pangocairo.h>
 #include <spdlog/spdlog.h>
 #include <spdlog/sinks/stdout_color_sinks.h>
@@ -17,353 +20,146 @@
 #include <stdio.h>
 #include <string.h>
 #include <time.h>
+#include <unordered_map>
+#include <vector>
 
 #include "calendar.h"
+#include "civil_date.h"
 #include "config.pb.h"
-
-#define SECS_PER_DAY (60 * 60 * 24)
-
-DEFINE_string(bible_reading_plans_path,
-    "/usr/local/etc/bible-reading-calendar/bible-reading-plans/",
-    "A path to bible reading plans directory.");
+#include "font_set.h"
+#include "ics_writer.h"
+#include "png_encoder.h"
+#include "raster_pool.h"
+#include "reading_plan.h"
+#include "text_cache.h"
+#include "worker_pool.h"
+
+DEFINE_int32(pdf_render_threads, 4,
+    "Number of threads drawing the pages of a PDF calendar concurrently. "
+    "0 draws them on the requesting thread.");
+DEFINE_uint64(max_sprite_pixels, 8 << 20,
+    "Largest sprite in pixels. Larger ones are refused rather than "
+    "allocated, 4 bytes a pixel.");
 
 namespace {
 
-const int days_per_months[] = {
-  31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
-
-template <typename Out>
-  void split(const std::string &s, char delim, Out result) {
-    std::istringstream iss(s);
-    std::string item;
-    while (std::getline(iss, item, delim)) {
-      *result++ = item;
-    }
-  }
-
-std::vector<std::string> split(const std::string &s, char delim) {
-  std::vector<std::string> elems;
-  split(s, delim, std::back_inserter(elems));
-  return elems;
+cairo_status_t write_to_ostream(
+    void* closure, const unsigned char* data, unsigned int length)
+{
+  std::ostream* ostream = (std::ostream*) closure;
+  ostream->write((const char*) data, length);
+  return *ostream ? CAIRO_STATUS_SUCCESS : CAIRO_STATUS_WRITE_ERROR;
 }
 
-std::string join(const std::vector<std::string>& v,
-    const std::string& delimiter)
+void append_json_string(const std::string& value, std::string* json)
 {
-  std::string ret;
-  bool first = true;
-  for (const auto& s : v) {
-    if (first) {
-      first = false;
-    } else {
-      ret += delimiter;
+  *json += '"';
+  for (char c : value) {
+    if (c == '"' || c == '\\') {
+      *json += '\\';
     }
-    ret += s;
+    *json += c;
   }
-  return ret;
-}
-
-struct tm* get_next_day(time_t *t) {
-  *t += SECS_PER_DAY;
-  return localtime(t);
-}
-
-time_t get_date_in_sec(int year, int month, int day) {
-  struct tm timeinfo = {0};
-
-  timeinfo.tm_year = year - 1900;
-  timeinfo.tm_mon = month - 1;
-  timeinfo.tm_mday = day;
-
-  return mktime(&timeinfo);
-}
-
-time_t get_first_day_of_month_in_sec(int year, int month) {
-  return get_date_in_sec(year, month, 1);
+  *json += '"';
 }
 
-PangoLayout* init_pango_layout(cairo_t *cr,
+PangoFontDescription* create_font_description(
     const std::string& font_family, double font_size) {
-  PangoLayout *layout = pango_cairo_create_layout(cr);
   PangoFontDescription *desc =
     pango_font_description_from_string(font_family.c_str());
   pango_font_description_set_absolute_size(desc, font_size * PANGO_SCALE);
-  pango_layout_set_font_description(layout, desc);
-  pango_font_description_free(desc);
-  return layout;
-}
-
-int get_wday_index(struct tm const &timeinfo) {
-  return timeinfo.tm_wday;
-}
-
-int count_weeks(int year, int month)
-{
-  time_t t = get_first_day_of_month_in_sec(year, month);
-  struct tm timeinfo = *localtime(&t);
-  int last_day_1st_week = 7 - get_wday_index(timeinfo);
-  int days_after_1st_week = days_per_months[month - 1] - last_day_1st_week;
-  int weeks = days_after_1st_week / 7 + 1;
-  if (days_after_1st_week % 7 > 0) {
-    weeks += 1;
-  }
-  return weeks;
+  return desc;
 }
 
-} // namespace
-
-class ReadingUnit {
+// Number of reading days in a plan year, memoized by every input it depends
+// on: the length of the year, the weekday it starts on and the rest days.
+class PlanLengthTable {
   public:
-    ReadingUnit() {}
-
-    std::string Print(config::Language language, bool use_full_name) const {
-      std::string text = getBookName(from_book, language, use_full_name);
-      text += " " + from_chapter;
-
-      if (!from_verse.empty()) {
-        text += ":" + from_verse;
-      }
-
-      if (!to_book.empty()) {
-        text += "-";
-        if (from_book != to_book) {
-          text +=
-            getBookName(to_book, language, use_full_name) + " ";
-        }
-
-        if (!to_chapter.empty() &&
-            (from_book != to_book ||
-             from_chapter != to_chapter)) {
-          text += to_chapter;
-        }
-
-        if (!to_verse.empty()) {
-          text += ":" + to_verse;
+    constexpr PlanLengthTable() : days_()
+    {
+      for (int year_days = 365; year_days <= 366; ++year_days) {
+        for (int first_wday = 0; first_wday < 7; ++first_wday) {
+          for (int mask = 0; mask < 128; ++mask) {
+            days_[year_days - 365][first_wday][mask] = year_days -
+              RestDays(mask).Count(first_wday, year_days);
+          }
         }
       }
-      return text;
     }
 
-    std::string from_book;
-    std::string from_chapter;
-    std::string from_verse;
-
-    std::string to_book;
-    std::string to_chapter;
-    std::string to_verse;
-
-  private:
-    static std::string getBookName(
-        const std::string& book_id, config::Language language, bool use_full_name)
+    constexpr int Get(int year_days, int first_wday, RestDays rest_days) const
     {
-      const auto& book = books_[language][book_id];
-      if (use_full_name) {
-        return book.full_name;
-      } else {
-        return book.short_name;
-      }
+      return days_[year_days - 365][first_wday][rest_days.mask()];
     }
 
-    static std::map<config::Language, std::map<std::string, Book>> books_;
-};
-
-std::map<config::Language, std::map<std::string, Book>> ReadingUnit::books_ = {
-  { config::Language::KOREAN,
-    {
-      {"Genesis", {"창", "창세기"}},
-      {"Exodus", {"출", "출애굽기"}},
-      {"Leviticus", {"레", "레위기"}},
-      {"Numbers", {"민", "민수기"}},
-      {"Deuteronomy", {"신", "신명기"}},
-      {"Joshua", {"수", "여호수아"}},
-      {"Judges", {"삿", "사사기"}},
-      {"Ruth", {"룻", "룻기"}},
-      {"1 Samuel", {"삼상", "사무엘상"}},
-      {"2 Samuel", {"삼하", "사무엘하"}},
-      {"1 Kings", {"왕상", "열왕기상"}},
-      {"2 Kings", {"왕하", "열왕기하"}},
-      {"1 Chronicles", {"대상", "역대상"}},
-      {"2 Chronicles", {"대하", "역대하"}},
-      {"Ezra", {"스", "에스라"}},
-      {"Nehemiah", {"느", "느헤미야"}},
-      {"Esther", {"에", "에스더"}},
-      {"Job", {"욥", "욥기"}},
-      {"Psalms", {"시", "시편"}},
-      {"Proverbs", {"잠", "잠언"}},
-      {"Ecclesiastes", {"전", "전도서"}},
-      {"Song of Solomon", {"아", "아가"}},
-      {"Isaiah", {"사", "이사야"}},
-      {"Jeremiah", {"렘", "예레미야"}},
-      {"Lamentations", {"애", "예레미야애가"}},
-      {"Ezekiel", {"겔", "에스겔"}},
-      {"Daniel", {"단", "다니엘"}},
-      {"Hosea", {"호", "호세아"}},
-      {"Joel", {"욜", "요엘"}},
-      {"Amos", {"암", "아모스"}},
-      {"Obadiah", {"옵", "오바댜"}},
-      {"Jonah", {"욘", "요나"}},
-      {"Micah", {"미", "미가"}},
-      {"Nahum", {"나", "나훔"}},
-      {"Habakkuk", {"합", "하박국"}},
-      {"Zephaniah", {"습", "스바냐"}},
-      {"Haggai", {"학", "학개"}},
-      {"Zechariah", {"슥", "스가랴"}},
-      {"Malachi", {"말", "말라기"}},
-      {"Matthew", {"마", "마태복음"}},
-      {"Mark", {"막", "마가복음"}},
-      {"Luke", {"눅", "누가복음"}},
-      {"John", {"요", "요한복음"}},
-      {"Acts", {"행", "사도행전"}},
-      {"Romans", {"롬", "로마서"}},
-      {"1 Corinthians", {"고전", "고린도전서"}},
-      {"2 Corinthians", {"고후", "고린도후서"}},
-      {"Galatians", {"갈", "갈라디아서"}},
-      {"Ephesians", {"엡", "에베소서"}},
-      {"Philippians", {"빌", "빌립보서"}},
-      {"Colossians", {"골", "골로새서"}},
-      {"1 Thessalonians", {"살전", "데살로니가전서"}},
-      {"2 Thessalonians", {"살후", "데살로니가후서"}},
-      {"1 Timothy", {"딤전", "디모데전서"}},
-      {"2 Timothy", {"딤후", "디모데후서"}},
-      {"Titus", {"디", "디도서"}},
-      {"Philemon", {"몬", "빌레몬서"}},
-      {"Hebrews", {"히", "히브리서"}},
-      {"James", {"약", "야고보서"}},
-      {"1 Peter", {"벧전", "베드로전서"}},
-      {"2 Peter", {"벧후", "베드로후서"}},
-      {"1 John", {"요일", "요한일서"}},
-      {"2 John", {"요이", "요한이서"}},
-      {"3 John", {"요삼", "요한삼서"}},
-      {"Jude", {"유", "유다서"}},
-      {"Revelation", {"계", "요한계시록"}}
-    }},
-  { config::Language::ENGLISH,
-    {
-      {"Genesis", {"Gen", "Genesis"}},
-      {"Exodus", {"Ex", "Exodus"}},
-      {"Leviticus", {"Lev", "Leviticus"}},
-      {"Numbers", {"Num", "Numbers"}},
-      {"Deuteronomy", {"Deut", "Deuteronomy"}},
-      {"Joshua", {"Josh", "Joshua"}},
-      {"Judges", {"Judg", "Judges"}},
-      {"Ruth", {"Ruth", "Ruth"}},
-      {"1 Samuel", {"1 Sam", "1 Samuel"}},
-      {"2 Samuel", {"2 Sam", "2 Samuel"}},
-      {"1 Kings", {"1 Ki", "1 Kings"}},
-      {"2 Kings", {"2 Ki", "2 Kings"}},
-      {"1 Chronicles", {"1 Chr", "1 Chronicles"}},
-      {"2 Chronicles", {"2 Chr", "2 Chronicles"}},
-      {"Ezra", {"Ezra", "Ezra"}},
-      {"Nehemiah", {"Neh", "Nehemiah"}},
-      {"Esther", {"Est", "Esther"}},
-      {"Job", {"Job", "Job"}},
-      {"Psalms", {"Ps", "Psalms"}},
-      {"Proverbs", {"Prov", "Proverbs"}},
-      {"Ecclesiastes", {"Eccles", "Ecclesiastes"}},
-      {"Song of Solomon", {"Song", "Song of Solomon"}},
-      {"Isaiah", {"Isa", "Isaiah"}},
-      {"Jeremiah", {"Jer", "Jeremiah"}},
-      {"Lamentations", {"Lam", "Lamentations"}},
-      {"Ezekiel", {"Ezek", "Ezekiel"}},
-      {"Daniel", {"Dan", "Daniel"}},
-      {"Hosea", {"Hosea", "Hosea"}},
-      {"Joel", {"Joel", "Joel"}},
-      {"Amos", {"Amos", "Amos"}},
-      {"Obadiah", {"Obad", "Obadiah"}},
-      {"Jonah", {"Jonah", "Jonah"}},
-      {"Micah", {"Micah", "Micah"}},
-      {"Nahum", {"Nahum", "Nahum"}},
-      {"Habakkuk", {"Hab", "Habakkuk"}},
-      {"Zephaniah", {"Zeph", "Zephaniah"}},
-      {"Haggai", {"Hag", "Haggai"}},
-      {"Zechariah", {"Zech", "Zechariah"}},
-      {"Malachi", {"Mal", "Malachi"}},
-      {"Matthew", {"Matt", "Matthew"}},
-      {"Mark", {"Mark", "Mark"}},
-      {"Luke", {"Lu", "Luke"}},
-      {"John", {"John", "John"}},
-      {"Acts", {"Acts", "Acts"}},
-      {"Romans", {"Rom", "Romans"}},
-      {"1 Corinthians", {"1 Cor", "1 Corinthians"}},
-      {"2 Corinthians", {"2 Cor", "2 Corinthians"}},
-      {"Galatians", {"Gal", "Galatians"}},
-      {"Ephesians", {"Eph", "Ephesians"}},
-      {"Philippians", {"Phil", "Philippians"}},
-      {"Colossians", {"Col", "Colossians"}},
-      {"1 Thessalonians", {"1 Thess", "1 Thessalonians"}},
-      {"2 Thessalonians", {"2 Thess", "2 Thessalonians"}},
-      {"1 Timothy", {"1 Tim", "1 Timothy"}},
-      {"2 Timothy", {"2 Tim", "2 Timothy"}},
-      {"Titus", {"Titus", "Titus"}},
-      {"Philemon", {"Philem", "Philemon"}},
-      {"Hebrews", {"Heb", "Hebrews"}},
-      {"James", {"James", "James"}},
-      {"1 Peter", {"1 Peter", "1 Peter"}},
-      {"2 Peter", {"2 Peter", "2 Peter"}},
-      {"1 John", {"1 John", "1 John"}},
-      {"2 John", {"2 John", "2 John"}},
-      {"3 John", {"3 John", "3 John"}},
-      {"Jude", {"Jude", "Jude"}},
-      {"Revelation", {"Rev", "Revelation"}}
-    }},
+  private:
+    uint16_t days_[2][7][128];
 };
 
-class DailyReading {
-  public:
-    DailyReading() {}
+constexpr PlanLengthTable plan_length_table;
 
-    void PushBack(ReadingUnit reading_unit) {
-      reading_units_.push_back(std::move(reading_unit));
-    }
+static_assert(plan_length_table.Get(365, 0, RestDays(0)) == 365, "");
+static_assert(plan_length_table.Get(365, 5, RestDays(1 << 0)) == 313,
+    "A 365-day year starting on a Friday has 53 Fridays and 52 Sundays");
 
-    std::string Print(config::Language language) {
-      std::vector<std::string> tokens;
-      for (const auto& reading_unit : reading_units_) {
-        tokens.push_back(reading_unit.Print(language, true));
-      }
-      return join(tokens, "\\n");
+// Month frames of the calling thread, recorded once and replayed for every
+// month with the same layout. They never leave the thread; see
+// Calendar::replayFrame().
+class FrameCache {
+  public:
+    struct Frame {
+      cairo_surface_t* surface;
+      // Offset and cell height of the RenderContext after the frame is drawn.
+      double y_offset;
+      double cell_height;
+    };
+
+    ~FrameCache() {
+      clear();
     }
 
-    std::string PrintShort(config::Language language) {
-      std::vector<std::string> tokens;
-      for (const auto& reading_unit : reading_units_) {
-        tokens.push_back(reading_unit.Print(language, false));
-      }
-      return join(tokens, "\n");
+    const Frame* Find(const std::string& key) const {
+      auto it = frames_.find(key);
+      return it == frames_.end() ? nullptr : &it->second;
     }
 
-    std::string PrintSingleLine(config::Language language) {
-      std::vector<std::string> tokens;
-      for (const auto& reading_unit : reading_units_) {
-        tokens.push_back(reading_unit.Print(language, false));
+    const Frame& Insert(const std::string& key, Frame frame) {
+      // There are only a handful of layouts, so a full cache means the
+      // configs are unusual; just start over.
+      if (frames_.size() >= kMaxFrames) {
+        clear();
       }
-      return join(tokens, ", ");
+      return frames_.emplace(key, frame).first->second;
     }
 
   private:
-    std::list<ReadingUnit> reading_units_;
-};
+    static const size_t kMaxFrames = 64;
 
-class ReadingPlan {
-  public:
-    ReadingPlan() {
+    void clear() {
+      for (auto& it : frames_) {
+        cairo_surface_destroy(it.second.surface);
+      }
+      frames_.clear();
     }
 
-    void PushBack(DailyReading daily_reading) {
-      daily_readings_.push_back(std::move(daily_reading));
-    }
+    std::unordered_map<std::string, Frame> frames_;
+};
 
-    DailyReading PopFront() {
-      DailyReading front = daily_readings_.front();
-      daily_readings_.pop_front();
-      return front;
-    }
+thread_local FrameCache frame_cache;
 
-    bool empty() { return daily_readings_.empty(); }
+int count_weeks(int year, int month)
+{
+  int last_day_1st_week =
+    7 - weekday_from_days(days_from_civil(year, month, 1));
+  int days_after_1st_week = days_in_month(year, month) - last_day_1st_week;
+  int weeks = days_after_1st_week / 7 + 1;
+  if (days_after_1st_week % 7 > 0) {
+    weeks += 1;
+  }
+  return weeks;
+}
 
-  private:
-    std::list<DailyReading> daily_readings_;
-};
+} // namespace
 
 std::shared_ptr<spdlog::logger> Calendar::logger_ =
   spdlog::stdout_color_mt("calendar");
@@ -383,246 +179,277 @@ Calendar::Calendar(config::CalendarConfig conf) :
   }
   conf_.set_cell_width(((double)
         surface_width_ - conf_.cell_margin() * 2) / 7);
+
+  for (const auto& day_to_rest : conf_.days_to_rest()) {
+    rest_days_.Add(day_to_rest);
+  }
+
+  initTextContext();
 }
 
-bool Calendar::shouldInclude(const struct tm& tm)
+Calendar::~Calendar()
 {
-  for (const auto& day_to_rest : conf_.days_to_rest()) {
-    if (tm.tm_wday == day_to_rest) return false;
+  for (int role = 0; role < TEXT_ROLE_COUNT; ++role) {
+    pango_font_description_free(font_descriptions_[role]);
   }
-  return true;
 }
 
-int Calendar::countDays(int year_index)
+void Calendar::initTextContext()
 {
-  int start_year = conf_.start_year() + year_index;
+  font_descriptions_[MONTH_LABEL] = create_font_description(
+      conf_.has_month_label_font_family() ?
+      conf_.month_label_font_family() :
+      conf_.default_font_family(),
+      conf_.month_label_font_size());
+  font_descriptions_[WDAY_LABEL] = create_font_description(
+      conf_.has_wday_label_font_family() ?
+      conf_.wday_label_font_family() :
+      conf_.default_font_family(),
+      conf_.wday_label_font_size());
+  font_descriptions_[DAY_NUMBER] = create_font_description(
+      conf_.has_day_number_font_family() ?
+      conf_.day_number_font_family() :
+      conf_.default_font_family(),
+      conf_.day_number_font_size());
+  font_descriptions_[DAY_PLAN] = create_font_description(
+      conf_.has_day_plan_font_family() ?
+      conf_.day_plan_font_family() :
+      conf_.default_font_family(),
+      conf_.day_plan_font_size());
 
-  time_t t = get_date_in_sec(
-      start_year, conf_.start_month(), conf_.start_day());
-  struct tm timeinfo = *localtime(&t);
-  int counter = 0;
-  while (timeinfo.tm_year + 1900 == start_year ||
-      timeinfo.tm_mon + 1 < conf_.start_month() ||
-      timeinfo.tm_mday < conf_.start_day()) {
-    if (shouldInclude(timeinfo)) {
-      ++counter;
-    }
-    timeinfo = *get_next_day(&t);
+  for (int role = 0; role < TEXT_ROLE_COUNT; ++role) {
+    char* font_key = pango_font_description_to_string(
+        font_descriptions_[role]);
+    font_keys_[role] = font_key;
+    g_free(font_key);
   }
-  return counter;
 }
 
-std::string Calendar::getPlanFileName(int year_index)
+WorkerPool& Calendar::pagePool()
 {
-  std::vector<std::string> file_name_tokens;
-  switch (conf_.coverage_type()) {
-    case config::CoverageType::NEW_TESTAMENT:
-      file_name_tokens.push_back("new-testament");
-      break;
-    case config::CoverageType::OLD_TESTAMENT:
-      file_name_tokens.push_back("old-testament");
-      break;
-    case config::CoverageType::NEW_TESTAMENT_AND_PSALMS:
-      file_name_tokens.push_back("new-testament-and-psalms");
-      break;
-    case config::CoverageType::WHOLE_BIBLE:
-      file_name_tokens.push_back("whole-bible");
-      break;
-    case config::CoverageType::WHOLE_BIBLE_NEW_TESTAMENT_FIRST:
-      file_name_tokens.push_back("whole-bible-new-testament-first");
-      break;
-    case config::CoverageType::WHOLE_BIBLE_IN_PARALLEL:
-      file_name_tokens.push_back("whole-bible-in-parallel");
-      break;
-    default:
-      logger_->error("Unknown CoverageType: {}", conf_.coverage_type());
+  // Shared by all requests, so that its threads keep their caches warm.
+  static WorkerPool pool(std::max(FLAGS_pdf_render_threads, 0));
+  return pool;
+}
+
+void Calendar::loadFonts() const
+{
+  FontSet::UseOnThisThread();
+  PangoFontMap* font_map = pango_cairo_font_map_get_default();
+  PangoContext* context = pango_font_map_create_context(font_map);
+  for (int role = 0; role < TEXT_ROLE_COUNT; ++role) {
+    PangoFont* font = pango_font_map_load_font(font_map, context,
+        font_descriptions_[role]);
+    if (font == nullptr) {
+      logger_->error("No font for [{}]!", font_keys_[role]);
+      continue;
+    }
+    PangoFontDescription* loaded = pango_font_describe(font);
+    char* loaded_key = pango_font_description_to_string(loaded);
+    logger_->debug("[{}] resolves to [{}]", font_keys_[role], loaded_key);
+    g_free(loaded_key);
+    pango_font_description_free(loaded);
+    g_object_unref(font);
   }
+  g_object_unref(context);
+}
 
-  switch (conf_.duration_type()) {
-    case config::DurationType::ONE_YEAR:
-      file_name_tokens.push_back("1-year");
-      break;
-    case config::DurationType::TWO_YEARS:
-      if (year_index == 0) {
-        file_name_tokens.push_back("2-years-1st");
-      } else {
-        file_name_tokens.push_back("2-years-2nd");
-      }
-      break;
-  };
-  file_name_tokens.push_back(std::to_string(countDays(year_index)));
-  return FLAGS_bible_reading_plans_path +
-    join(file_name_tokens, "_") + ".csv";
+const TextCache::ShapedText& Calendar::shapeText(
+    const RenderContext& context, TextRole role, const char* text) const
+{
+  return TextCache::Get().Shape(context.cr, font_keys_[role],
+      font_descriptions_[role], conf_.language(),
+      role == DAY_PLAN ? PANGO_ALIGN_RIGHT : PANGO_ALIGN_LEFT, text);
 }
 
-ReadingPlan Calendar::getBibleReadingPlan()
+bool Calendar::shouldInclude(int wday) const
 {
-  ReadingPlan bible_reading_plan;
-  readPlanFile(getPlanFileName(0), &bible_reading_plan);
-  if (conf_.duration_type() == config::DurationType::TWO_YEARS) {
-    readPlanFile(getPlanFileName(1), &bible_reading_plan);
+  return !rest_days_.Contains(wday);
+}
+
+int Calendar::getStartDays(int year_index) const
+{
+  return days_from_civil(conf_.start_year() + year_index,
+      conf_.start_month(), conf_.start_day());
+}
+
+int Calendar::countDays(int year_index) const
+{
+  int start = getStartDays(year_index);
+  return plan_length_table.Get(getStartDays(year_index + 1) - start,
+      weekday_from_days(start), rest_days_);
+}
+
+PlanKey Calendar::getPlanKey(int year_index) const
+{
+  return {conf_.coverage_type(), conf_.duration_type(), year_index,
+    countDays(year_index)};
+}
+
+int Calendar::countPlanYears() const
+{
+  return conf_.duration_type() == config::DurationType::TWO_YEARS ? 2 : 1;
+}
+
+bool Calendar::hasReadingPlan() const
+{
+  for (int year_index = 0; year_index < countPlanYears(); ++year_index) {
+    PlanKey key = getPlanKey(year_index);
+    if (PlanRegistry::Get().Find(key) == nullptr) {
+      logger_->error("No reading plan for [{}]!",
+          PlanRegistry::getPlanFileName(key));
+      return false;
+    }
   }
-  return bible_reading_plan;
+  return true;
 }
 
-void Calendar::readPlanFile(const std::string file_name,
-    ReadingPlan* bible_reading_plan)
+ReadingPlan Calendar::getBibleReadingPlan() const
 {
-  logger_->debug(file_name);
+  ReadingPlan bible_reading_plan(PlanRegistry::Get().pack());
+  for (int year_index = 0; year_index < countPlanYears(); ++year_index) {
+    const PackPlan* plan = PlanRegistry::Get().Find(getPlanKey(year_index));
+    if (plan != nullptr) {
+      bible_reading_plan.Append(*plan);
+    }
+  }
+  return bible_reading_plan;
+}
 
-  std::ifstream infile(file_name);
-  if (!infile) {
-    logger_->error("Cannot open [{}]!", file_name);
+void Calendar::initContext(cairo_t* cr) const
+{
+  if (conf_.quality() != config::RenderQuality::FAST) {
     return;
   }
-  std::string line;
-  while (std::getline(infile, line)) {
-    auto tokens = split(line, ',');
-    DailyReading daily_reading;
-    for (int i = 1; i < tokens.size(); i += 6) {
-      ReadingUnit reading_unit;
+  cairo_set_antialias(cr, CAIRO_ANTIALIAS_FAST);
 
-      reading_unit.from_book = tokens[i];
-      reading_unit.from_chapter = tokens[i + 1];
-      reading_unit.from_verse = tokens[i + 2];
+  cairo_font_options_t* font_options = cairo_font_options_create();
+  cairo_font_options_set_antialias(font_options, CAIRO_ANTIALIAS_GRAY);
+  cairo_font_options_set_hint_style(font_options, CAIRO_HINT_STYLE_FULL);
+  cairo_font_options_set_hint_metrics(font_options, CAIRO_HINT_METRICS_ON);
+  cairo_set_font_options(cr, font_options);
+  cairo_font_options_destroy(font_options);
+}
 
-      reading_unit.to_book = tokens[i + 3];
-      if (i + 4 < tokens.size()) {
-        reading_unit.to_chapter = tokens[i + 4];
-      }
-      if (i + 5 < tokens.size()) {
-        reading_unit.to_verse = tokens[i + 5];
-      }
+cairo_surface_t* Calendar::createImageSurface() const
+{
+  cairo_surface_t* surface = RasterPool::Get().CreateSurface(
+      getPixelWidth(), getPixelHeight());
+  cairo_surface_set_device_scale(surface, conf_.scale(), conf_.scale());
+  return surface;
+}
 
-      daily_reading.PushBack(reading_unit);
-    }
-    bible_reading_plan->PushBack(daily_reading);
-  }
+int Calendar::getPixelWidth() const
+{
+  return std::ceil(surface_width_ * conf_.scale());
+}
+
+int Calendar::getPixelHeight() const
+{
+  return std::ceil(surface_height_ * conf_.scale());
 }
 
-double Calendar::getDayX(int x_index)
+double Calendar::getDayX(int x_index) const
 {
   return x_index * conf_.cell_width() + conf_.cell_margin();
 }
 
-double Calendar::getDayY(int y_index)
+double Calendar::getDayY(const RenderContext& context, int y_index) const
 {
-  return y_index * conf_.cell_height() + y_offset_;
+  return y_index * context.cell_height + context.y_offset;
 }
 
-void Calendar::drawMonthLabel(int month) {
-  static std::vector<std::string> month_text = {
+void Calendar::drawMonthLabel(RenderContext* context, int month) const {
+  static const char* month_text[] = {
     "January", "February", "March", "April", "May", "June", "July",
     "August", "September", "October", "November", "December"};
 
-  PangoLayout *layout =
-    init_pango_layout(cr_, conf_.has_month_label_font_family() ?
-        conf_.month_label_font_family() :
-        conf_.default_font_family(),
-        conf_.month_label_font_size());
+  char buf[16];
+  const char* text = buf;
   if (conf_.language() == config::Language::ENGLISH) {
+    text = month_text[month - 1];
     if (conf_.month_label_uppercase()) {
-      auto& str = month_text[month - 1];
-      std::transform(str.begin(), str.end(), str.begin(), ::toupper);
+      // Months may be drawn concurrently, so uppercase a copy.
+      snprintf(buf, sizeof(buf), "%s", text);
+      for (char* c = buf; *c; ++c) {
+        *c = toupper(*c);
+      }
+      text = buf;
     }
-    pango_layout_set_text(layout, month_text[month - 1].c_str(), -1);
   } else {
-    char buf[3];
     sprintf(buf, "%d", month);
-    pango_layout_set_text(layout, buf, -1);
   }
 
-  int width, height;
-  pango_layout_get_size(layout, &width, &height);
-  cairo_move_to(cr_,
-      (surface_width_ - ((double) width / PANGO_SCALE)) / 2,
+  const auto& shaped_text = shapeText(*context, MONTH_LABEL, text);
+  cairo_move_to(context->cr,
+      (surface_width_ - shaped_text.width) / 2,
       conf_.margin_top());
-  y_offset_ += (double) height / PANGO_SCALE +
+  context->y_offset += shaped_text.height +
     conf_.margin_top() + conf_.cell_margin();
-  logger_->debug("y_offset_: {}" , y_offset_);
-  pango_cairo_show_layout(cr_, layout);
-
-  g_object_unref(layout);
+  logger_->debug("y_offset: {}" , context->y_offset);
+  pango_cairo_show_layout(context->cr, shaped_text.layout);
 }
 
-void Calendar::drawWdayLabel() {
-  const char *wday_text[] = {"Sunday", "Monday", "Tuesday",
+void Calendar::drawWdayLabel(RenderContext* context) const {
+  static const char* const wday_text[] = {"Sunday", "Monday", "Tuesday",
     "Wednesday", "Thursday", "Friday", "Saturday"};
 
-  const char *wday_text_ko[] = {
+  static const char* const wday_text_ko[] = {
     "일", "월", "화", "수", "목", "금", "토"};
 
   double max_height = 0;
   for (int i = 0; i < 7; ++i) {
-    PangoLayout *layout =
-      init_pango_layout(cr_, conf_.has_wday_label_font_family() ?
-          conf_.wday_label_font_family() :
-          conf_.default_font_family(),
-          conf_.wday_label_font_size());
-    pango_layout_set_text(layout,
+    const auto& shaped_text = shapeText(*context, WDAY_LABEL,
         conf_.language() == config::Language::ENGLISH ?
-        wday_text[i] : wday_text_ko[i],
-        -1);
-
-    int width, height;
-    pango_layout_get_size(layout, &width, &height);
-
-    cairo_move_to(cr_, conf_.cell_margin() + i * conf_.cell_width() +
-        (conf_.cell_width() - ((double) width / PANGO_SCALE)) /
-        2,
-        y_offset_ + conf_.cell_margin());
-    pango_cairo_show_layout(cr_, layout);
+        wday_text[i] : wday_text_ko[i]);
 
-    g_object_unref(layout);
+    cairo_move_to(context->cr, conf_.cell_margin() + i * conf_.cell_width() +
+        (conf_.cell_width() - shaped_text.width) / 2,
+        context->y_offset + conf_.cell_margin());
+    pango_cairo_show_layout(context->cr, shaped_text.layout);
 
-    max_height = std::max(max_height,
-        (double) height / PANGO_SCALE);
+    max_height = std::max(max_height, shaped_text.height);
   }
-  y_offset_ += max_height + conf_.cell_margin() * 2;
+  context->y_offset += max_height + conf_.cell_margin() * 2;
 }
 
-void Calendar::skipMonth(int year, int month,
-    ReadingPlan* bible_reading_plan)
+uint32_t Calendar::countReadingDaysBefore(int year, int month) const
 {
-  time_t t;
   if (year == conf_.start_year() && month == conf_.start_month()) {
-    t = get_date_in_sec(year, month, conf_.start_day());
-  } else {
-    t = get_first_day_of_month_in_sec(year, month);
+    return 0;
   }
-  struct tm timeinfo = *localtime(&t);
+  return countReadingDaysBefore(days_from_civil(year, month, 1));
+}
 
-  while (timeinfo.tm_mon == month - 1) {
-    if (shouldInclude(timeinfo)) {
-      bible_reading_plan->PopFront();
-    }
-    timeinfo = *get_next_day(&t);
+uint32_t Calendar::countReadingDaysBefore(int days) const
+{
+  int start = getStartDays(0);
+  if (days <= start) {
+    return 0;
   }
+  days -= start;
+  return days - rest_days_.Count(weekday_from_days(start), days);
 }
 
-void Calendar::drawDaysOfMonth(int year, int month,
-    ReadingPlan* bible_reading_plan)
+void Calendar::drawDaysOfMonth(const RenderContext& context,
+    int year, int month, ReadingPlan* bible_reading_plan) const
 {
-  time_t t = get_first_day_of_month_in_sec(year, month);
-  struct tm timeinfo = *localtime(&t);
-
-  int x = get_wday_index(timeinfo);
+  int x = weekday_from_days(days_from_civil(year, month, 1));
   int y = 0;
-  while (timeinfo.tm_mon == month - 1) {
+  for (int day = 1; day <= days_in_month(year, month); ++day) {
     // Label
     char buf[4];
-    sprintf(buf, "%d", timeinfo.tm_mday);
-    drawTextOfDayNumber(x, y, buf);
+    sprintf(buf, "%d", day);
+    drawTextOfDayNumber(context, x, y, buf);
 
-    if (shouldInclude(timeinfo) &&
+    if (shouldInclude(x) &&
         !bible_reading_plan->empty() &&
         (year > conf_.start_year() || month > conf_.start_month() ||
-         timeinfo.tm_mday >= conf_.start_day())) {
-      drawTextOfDayPlan(x, y,
+         day >= conf_.start_day())) {
+      drawTextOfDayPlan(context, x, y,
           bible_reading_plan->PopFront().PrintShort(conf_.language()));
     }
 
-    timeinfo = *get_next_day(&t);
     x++;
     if (x >= 7) {
       x = 0;
@@ -631,47 +458,30 @@ void Calendar::drawDaysOfMonth(int year, int month,
   }
 }
 
-void Calendar::drawTextOfDayNumber(int x, int y, const char* text)
+void Calendar::drawTextOfDayNumber(const RenderContext& context,
+    int x, int y, const char* text) const
 {
-  PangoLayout *layout = init_pango_layout(cr_,
-      conf_.has_day_number_font_family() ?
-      conf_.day_number_font_family() :
-      conf_.default_font_family(),
-      conf_.day_number_font_size());
-  pango_layout_set_text(layout, text, -1);
+  const auto& shaped_text = shapeText(context, DAY_NUMBER, text);
 
-  cairo_move_to(cr_,
+  cairo_move_to(context.cr,
       getDayX(x) + conf_.cell_margin(),
-      getDayY(y) + conf_.cell_margin());
-  pango_cairo_show_layout(cr_, layout);
-
-  g_object_unref(layout);
+      getDayY(context, y) + conf_.cell_margin());
+  pango_cairo_show_layout(context.cr, shaped_text.layout);
 }
 
-void Calendar::drawTextOfDayPlan(int x, int y,
-    const std::string text)
+void Calendar::drawTextOfDayPlan(const RenderContext& context,
+    int x, int y, const std::string& text) const
 {
-  PangoLayout *layout =
-    init_pango_layout(cr_, conf_.has_day_plan_font_family() ?
-        conf_.day_plan_font_family() : conf_.default_font_family(),
-        conf_.day_plan_font_size());
-  pango_layout_set_alignment(layout, PANGO_ALIGN_RIGHT);
-  pango_layout_set_text(layout, text.c_str(), -1);
+  const auto& shaped_text = shapeText(context, DAY_PLAN, text.c_str());
 
-  int width, height;
-  pango_layout_get_size(layout, &width, &height);
-  cairo_move_to(cr_,
-      getDayX(x + 1) -
-      ((double) width / PANGO_SCALE) - conf_.cell_margin(),
-      getDayY(y + 1) -
-      ((double) height / PANGO_SCALE) - conf_.cell_margin());
-  pango_cairo_show_layout(cr_, layout);
-
-  g_object_unref(layout);
+  cairo_move_to(context.cr,
+      getDayX(x + 1) - shaped_text.width - conf_.cell_margin(),
+      getDayY(context, y + 1) - shaped_text.height - conf_.cell_margin());
+  pango_cairo_show_layout(context.cr, shaped_text.layout);
 }
 
 void Calendar::drawMonth(int year, int month,
-    ReadingPlan* bible_reading_plan)
+    ReadingPlan* bible_reading_plan) const
 {
   std::string output_file_name = conf_.output_file_name() + '_' +
     std::to_string(year) + '_' + std::to_string(month);
@@ -684,8 +494,7 @@ void Calendar::drawMonth(int year, int month,
           surface_width_, surface_height_);
       break;
     case config::OutputType::PNG:
-      surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
-          surface_width_, surface_height_);
+      surface = createImageSurface();
       break;
     default:
       surface = cairo_svg_surface_create(
@@ -697,71 +506,125 @@ void Calendar::drawMonth(int year, int month,
   drawMonthOnSurface(year, month, bible_reading_plan, surface);
 
   if (conf_.output_type() == config::OutputType::PNG) {
-    cairo_surface_write_to_png(surface,
-        (output_file_name + ".png").c_str());
+    std::ofstream ofstream(output_file_name + ".png", std::ios::binary);
+    PngEncoder::Write(surface, write_to_ostream, &ofstream);
   }
 
   cairo_surface_destroy(surface);
 }
 
 void Calendar::drawMonthOnSurface(int year, int month,
-    ReadingPlan* bible_reading_plan, cairo_surface_t* surface)
+    ReadingPlan* bible_reading_plan, cairo_surface_t* surface) const
 {
-  y_offset_ = 0;
-  cr_ = cairo_create(surface);
+  RenderContext context = {cairo_create(surface), 0, conf_.cell_height()};
+  initContext(context.cr);
 
   // Paint white background.
-  cairo_save(cr_);
-  cairo_set_source_rgb(cr_, 1, 1, 1);
-  cairo_paint(cr_);
-  cairo_restore(cr_);
+  cairo_save(context.cr);
+  cairo_set_source_rgb(context.cr, 1, 1, 1);
+  cairo_paint(context.cr);
+  cairo_restore(context.cr);
 
-  drawMonthLabel(month);
+  drawMonthLabel(&context, month);
 
-  // Draw frame
-  cairo_set_line_width(cr_, conf_.line_width());
+  replayFrame(&context, count_weeks(year, month));
 
-  cairo_rectangle(cr_, conf_.cell_margin(), y_offset_,
+  drawDaysOfMonth(context, year, month, bible_reading_plan);
+
+  cairo_destroy(context.cr);
+}
+
+void Calendar::replayFrame(RenderContext* context, int weeks) const
+{
+  // Vector targets get a frame of their own. A recorded PDF page keeps a
+  // reference to every surface painted into it and is replayed on another
+  // thread, while the frames of this thread are reused and destroyed here.
+  // An SVG names a painted recording by its process-wide surface id, so the
+  // same calendar would differ between threads and restarts.
+  const cairo_surface_type_t target_type =
+    cairo_surface_get_type(cairo_get_target(context->cr));
+  if (target_type == CAIRO_SURFACE_TYPE_RECORDING ||
+      target_type == CAIRO_SURFACE_TYPE_SVG) {
+    cairo_save(context->cr);
+    drawFrame(context, weeks);
+    cairo_restore(context->cr);
+    return;
+  }
+
+  char buf[128];
+  snprintf(buf, sizeof(buf), "%d %d %a %a %a %d %d %d %d ",
+      surface_width_, surface_height_, conf_.cell_margin(),
+      conf_.line_width(), context->y_offset, weeks, conf_.language(),
+      target_type, conf_.quality());
+  std::string key = buf + font_keys_[WDAY_LABEL];
+
+  const FrameCache::Frame* frame = frame_cache.Find(key);
+  if (frame == nullptr) {
+    cairo_rectangle_t extents = {0, 0,
+      (double) surface_width_, (double) surface_height_};
+    cairo_surface_t* recording = cairo_recording_surface_create(
+        CAIRO_CONTENT_COLOR_ALPHA, &extents);
+
+    RenderContext frame_context = *context;
+    frame_context.cr = cairo_create(recording);
+    initContext(frame_context.cr);
+    drawFrame(&frame_context, weeks);
+    cairo_destroy(frame_context.cr);
+
+    frame = &frame_cache.Insert(key, {recording,
+        frame_context.y_offset, frame_context.cell_height});
+  }
+
+  cairo_save(context->cr);
+  cairo_set_source_surface(context->cr, frame->surface, 0, 0);
+  cairo_paint(context->cr);
+  cairo_restore(context->cr);
+
+  context->y_offset = frame->y_offset;
+  context->cell_height = frame->cell_height;
+}
+
+void Calendar::drawFrame(RenderContext* context, int weeks) const
+{
+  cairo_t* cr = context->cr;
+  cairo_set_line_width(cr, conf_.line_width());
+
+  cairo_rectangle(cr, conf_.cell_margin(), context->y_offset,
       surface_width_ - conf_.cell_margin() * 2,
-      surface_height_ - y_offset_ - conf_.cell_margin());
+      surface_height_ - context->y_offset - conf_.cell_margin());
 
   for (int x = 1; x < 7; ++x) {
-    cairo_move_to(cr_, getDayX(x), y_offset_);
-    cairo_line_to(cr_, getDayX(x), surface_height_ - conf_.cell_margin());
+    cairo_move_to(cr, getDayX(x), context->y_offset);
+    cairo_line_to(cr, getDayX(x), surface_height_ - conf_.cell_margin());
   }
 
-  drawWdayLabel();
+  drawWdayLabel(context);
 
   // Stroke a line below the labels
-  cairo_move_to(cr_, conf_.cell_margin(), y_offset_);
-  cairo_line_to(cr_, surface_width_ - conf_.cell_margin(), y_offset_);
+  cairo_move_to(cr, conf_.cell_margin(), context->y_offset);
+  cairo_line_to(cr, surface_width_ - conf_.cell_margin(), context->y_offset);
 
   // Horizontal lines below dates
-  conf_.set_cell_height(
-      ((double) surface_height_ - conf_.cell_margin() - y_offset_) /
-      count_weeks(year, month));
-
-  for (int y = 1; y < count_weeks(year, month); ++y) {
-    cairo_move_to(cr_, conf_.cell_margin(),
-        y_offset_ + y * conf_.cell_height());
-    cairo_line_to(cr_, surface_width_ - conf_.cell_margin(),
-        y_offset_ + y * conf_.cell_height());
+  context->cell_height = ((double) surface_height_ - conf_.cell_margin() -
+      context->y_offset) / weeks;
+
+  for (int y = 1; y < weeks; ++y) {
+    cairo_move_to(cr, conf_.cell_margin(),
+        context->y_offset + y * context->cell_height);
+    cairo_line_to(cr, surface_width_ - conf_.cell_margin(),
+        context->y_offset + y * context->cell_height);
   }
 
-  cairo_stroke(cr_);
-
-  drawDaysOfMonth(year, month, bible_reading_plan);
-
-  cairo_destroy(cr_);
+  cairo_stroke(cr);
 }
 
-void Calendar::initMonthIteration(int* y, int* m)
+void Calendar::initMonthIteration(int* y, int* m) const
 {
   *y = conf_.start_year();
   *m = conf_.start_month();
 }
 
-bool Calendar::isReadingMonth(int y, int m)
+bool Calendar::isReadingMonth(int y, int m) const
 {
   int last_year = conf_.start_year() + 1;
   if (conf_.duration_type() == config::DurationType::TWO_YEARS) {
@@ -781,12 +644,21 @@ bool Calendar::isReadingMonth(int y, int m)
   return false;
 }
 
-bool Calendar::isSelectedMonth(int y, int m)
+bool Calendar::isSelectedMonthInPlan() const
 {
-  return y == conf_.year() && m == conf_.month();
+  int y = conf_.year();
+  int m = conf_.month();
+  if (m < 1 || m > 12) {
+    return false;
+  }
+  if (y < conf_.start_year() ||
+      (y == conf_.start_year() && m < conf_.start_month())) {
+    return false;
+  }
+  return isReadingMonth(y, m);
 }
 
-void Calendar::nextMonth(int* y, int* m)
+void Calendar::nextMonth(int* y, int* m) const
 {
   *m += 1;
   if (*m > 12) {
@@ -795,29 +667,45 @@ void Calendar::nextMonth(int* y, int* m)
   }
 }
 
-void Calendar::streamMonthOnSurface(cairo_surface_t* surface) {
+cairo_surface_t* Calendar::recordMonth(int year, int month,
+    ReadingPlan* bible_reading_plan) const
+{
+  cairo_rectangle_t extents = {0, 0,
+    (double) surface_width_, (double) surface_height_};
+  cairo_surface_t* recording = cairo_recording_surface_create(
+      CAIRO_CONTENT_COLOR_ALPHA, &extents);
+  drawMonthOnSurface(year, month, bible_reading_plan, recording);
+  return recording;
+}
+
+void Calendar::streamMonthOnSurface(cairo_surface_t* surface) const {
   ReadingPlan bible_reading_plan = getBibleReadingPlan();
 
-  int y, m;
-  initMonthIteration(&y, &m);
-  while (!isSelectedMonth(y, m)) {
-    skipMonth(y, m, &bible_reading_plan);
-    nextMonth(&y, &m);
-  }
+  int y = conf_.year();
+  int m = conf_.month();
+  bible_reading_plan.Skip(countReadingDaysBefore(y, m));
   drawMonthOnSurface(y, m, &bible_reading_plan, surface);
 }
 
-void Calendar::draw()
+void Calendar::draw() const
 {
+  if (!hasReadingPlan()) {
+    return;
+  }
+
   ReadingPlan bible_reading_plan = getBibleReadingPlan();
 
   int y, m;
   initMonthIteration(&y, &m);
   if (conf_.has_month()) {
-    while (!isSelectedMonth(y, m)) {
-      skipMonth(y, m, &bible_reading_plan);
-      nextMonth(&y, &m);
+    if (!isSelectedMonthInPlan()) {
+      logger_->error("{}-{} is not in the reading plan!",
+          conf_.year(), conf_.month());
+      return;
     }
+    y = conf_.year();
+    m = conf_.month();
+    bible_reading_plan.Skip(countReadingDaysBefore(y, m));
     drawMonth(y, m, &bible_reading_plan);
   } else {
     while (isReadingMonth(y, m)) {
@@ -827,8 +715,12 @@ void Calendar::draw()
   }
 }
 
-void Calendar::streamSvg(cairo_write_func_t writeFunc, void *closure)
+int Calendar::streamSvg(cairo_write_func_t writeFunc, void *closure) const
 {
+  if (!isSelectedMonthInPlan() || !hasReadingPlan()) {
+    return 404;
+  }
+
   cairo_surface_t* surface =
     cairo_svg_surface_create_for_stream(writeFunc, closure,
         surface_width_, surface_height_);
@@ -836,101 +728,282 @@ void Calendar::streamSvg(cairo_write_func_t writeFunc, void *closure)
   streamMonthOnSurface(surface);
 
   cairo_surface_destroy(surface);
+  return 200;
 }
 
-void Calendar::streamPng(cairo_write_func_t writeFunc, void *closure)
+cairo_surface_t* Calendar::drawImage() const
 {
-  cairo_surface_t* surface = cairo_image_surface_create(
-      CAIRO_FORMAT_ARGB32, surface_width_, surface_height_);
+  if (!isSelectedMonthInPlan() || !hasReadingPlan()) {
+    return nullptr;
+  }
 
+  cairo_surface_t* surface = createImageSurface();
   streamMonthOnSurface(surface);
+  return surface;
+}
 
-  cairo_surface_write_to_png_stream(surface, writeFunc, closure);
+int Calendar::streamPng(cairo_write_func_t writeFunc, void *closure) const
+{
+  cairo_surface_t* surface = drawImage();
+  if (surface == nullptr) {
+    return 404;
+  }
+
+  PngEncoder::Write(surface, writeFunc, closure);
   cairo_surface_destroy(surface);
+  return 200;
 }
 
-void Calendar::streamPdf(cairo_write_func_t writeFunc, void *closure)
+int Calendar::streamPdf(cairo_write_func_t writeFunc, void *closure) const
 {
+  if (!hasReadingPlan()) {
+    return 404;
+  }
+
   ReadingPlan bible_reading_plan = getBibleReadingPlan();
 
+  // Every page is recorded on the pool, starting from its own position in
+  // the plan, and then replayed in order. The pages share this Calendar,
+  // which they only read, and nothing cached by the thread that recorded
+  // them. With --pdf_render_threads=0 the pages are recorded here one after
+  // another, through the same recording surfaces.
+  std::vector<std::future<cairo_surface_t*>> pages;
+  int y, m;
+  initMonthIteration(&y, &m);
+  while (isReadingMonth(y, m)) {
+    ReadingPlan page_plan = bible_reading_plan;
+    page_plan.Skip(countReadingDaysBefore(y, m));
+    pages.push_back(pagePool().Submit(
+          [this, y, m, page_plan]() mutable {
+            return recordMonth(y, m, &page_plan);
+          }));
+    nextMonth(&y, &m);
+  }
+
   cairo_surface_t* surface =
     cairo_pdf_surface_create_for_stream(writeFunc, closure,
         surface_width_, surface_height_);
+  // Cairo dates the document at the time of the render otherwise, and every
+  // render of a config must give the same bytes, which its ETag stands for.
+  char create_date[32];
+  snprintf(create_date, sizeof(create_date), "%04d-%02d-%02dT00:00:00Z",
+      conf_.start_year(), conf_.start_month(), conf_.start_day());
+  cairo_pdf_surface_set_metadata(surface, CAIRO_PDF_METADATA_CREATE_DATE,
+      create_date);
+
+  for (auto& page : pages) {
+    cairo_surface_t* recording = page.get();
+    cairo_t* cr = cairo_create(surface);
+    cairo_set_source_surface(cr, recording, 0, 0);
+    cairo_paint(cr);
+    cairo_destroy(cr);
+    cairo_surface_destroy(recording);
+    cairo_surface_show_page(surface);
+  }
+  cairo_surface_destroy(surface);
+  return 200;
+}
+
+int Calendar::streamSprite(cairo_write_func_t writeFunc, void *closure) const
+{
+  const int months = countReadingMonths();
+  if (!hasReadingPlan() || months == 0) {
+    return 404;
+  }
+
+  const int columns = std::min(std::max(conf_.sprite_columns(), 1), months);
+  const int rows = (months + columns - 1) / columns;
+  const int tile_width = getPixelWidth();
+  const int tile_height = getPixelHeight();
+  const uint64_t pixels =
+    (uint64_t) tile_width * columns * tile_height * rows;
+  if (pixels > FLAGS_max_sprite_pixels) {
+    logger_->warn("Refusing a sprite of {} pixels", pixels);
+    return 400;
+  }
+  cairo_surface_t* sprite = RasterPool::Get().CreateSurface(
+      tile_width * columns, tile_height * rows);
+
+  ReadingPlan bible_reading_plan = getBibleReadingPlan();
 
   int y, m;
   initMonthIteration(&y, &m);
-  while (isReadingMonth(y, m)) {
-    drawMonthOnSurface(y, m, &bible_reading_plan, surface);
-    cairo_surface_show_page(surface);
+  for (int i = 0; i < months; ++i) {
+    cairo_surface_t* tile = cairo_surface_create_for_rectangle(sprite,
+        i % columns * tile_width, i / columns * tile_height,
+        tile_width, tile_height);
+    cairo_surface_set_device_scale(tile, conf_.scale(), conf_.scale());
+    drawMonthOnSurface(y, m, &bible_reading_plan, tile);
+    cairo_surface_destroy(tile);
     nextMonth(&y, &m);
   }
-  cairo_surface_destroy(surface);
+
+  PngEncoder::Write(sprite, writeFunc, closure);
+  cairo_surface_destroy(sprite);
+  return 200;
+}
+
+int Calendar::dailyReadingJson(int date, std::string* json) const
+{
+  const int days = days_from_yyyymmdd(date);
+  if (!hasReadingPlan() || days < getStartDays(0)) {
+    return 404;
+  }
+
+  ReadingPlan bible_reading_plan = getBibleReadingPlan();
+  const uint32_t index = countReadingDaysBefore(days);
+  bible_reading_plan.Skip(index);
+  if (bible_reading_plan.empty()) {
+    return 404;
+  }
+
+  char buf[64];
+  snprintf(buf, sizeof(buf), "{\"date\":\"%04d-%02d-%02d\",",
+      date / 10000, date / 100 % 100, date % 100);
+  *json += buf;
+  if (!shouldInclude(weekday_from_days(days))) {
+    *json += "\"rest\":true}";
+    return 200;
+  }
+  snprintf(buf, sizeof(buf), "\"rest\":false,\"day\":%u,", index + 1);
+  *json += buf;
+
+  const auto daily_reading = bible_reading_plan.PopFront();
+  const std::pair<config::Language, const char*> languages[] = {
+    {config::Language::ENGLISH, "en"},
+    {config::Language::KOREAN, "ko"},
+  };
+  std::string text;
+  *json += "\"readings\":{";
+  for (const auto& language : languages) {
+    if (&language != languages) {
+      *json += ',';
+    }
+    *json += '"';
+    *json += language.second;
+    *json += "\":[";
+    for (uint32_t i = 0; i < daily_reading.size(); ++i) {
+      if (i > 0) {
+        *json += ',';
+      }
+      text.clear();
+      daily_reading.unit(i).AppendTo(language.first, true, &text);
+      append_json_string(text, json);
+    }
+    *json += ']';
+  }
+  *json += "}}";
+  return 200;
 }
 
+int Calendar::countReadingMonths() const
+{
+  int months = 0;
+  int y, m;
+  initMonthIteration(&y, &m);
+  while (isReadingMonth(y, m)) {
+    ++months;
+    nextMonth(&y, &m);
+  }
+  return months;
+}
 
-int Calendar::iCalendar(std::ostream* ostream)
+int Calendar::iCalendar(cairo_write_func_t writeFunc, void *closure) const
 {
-  *ostream << "BEGIN:VCALENDAR" << std::endl;
-  *ostream << "VERSION:2.0" << std::endl;
+  if (!hasReadingPlan()) {
+    return 404;
+  }
+
+  IcsWriter ics(writeFunc, closure);
+  ics.Property("BEGIN", "VCALENDAR");
+  ics.Property("VERSION", "2.0");
 
-  *ostream << "PRODID:-//Bible Reading Calendar//biblereadingcalendar.com//";
   switch (conf_.language()) {
     case config::Language::ENGLISH:
-      *ostream << "EN";
+      ics.Property("PRODID",
+          "-//Bible Reading Calendar//biblereadingcalendar.com//EN");
       break;
     case config::Language::KOREAN:
-      *ostream << "KO";
+      ics.Property("PRODID",
+          "-//Bible Reading Calendar//biblereadingcalendar.com//KO");
       break;
   }
-  *ostream << std::endl;
 
-  *ostream << "CALSCALE:GREGORIAN" << std::endl;
-  *ostream << "METHOD:PUBLISH" << std::endl;
+  ics.Property("CALSCALE", "GREGORIAN");
+  ics.Property("METHOD", "PUBLISH");
 
-  *ostream << "X-WR-CALNAME:";
   switch (conf_.language()) {
     case config::Language::ENGLISH:
-      *ostream << "Bible Reading Calendar";
+      ics.TextProperty("X-WR-CALNAME", "Bible Reading Calendar");
       break;
     case config::Language::KOREAN:
-      *ostream << "성경 읽기 달력";
+      ics.TextProperty("X-WR-CALNAME", "성경 읽기 달력");
       break;
   }
-  *ostream << std::endl;
 
-  *ostream << "X-WR-TIMEZONE:Etc/GMT" << std::endl;
+  ics.Property("X-WR-TIMEZONE", "Etc/GMT");
 
   ReadingPlan bible_reading_plan = getBibleReadingPlan();
 
-  time_t t = get_date_in_sec(
-      conf_.start_year(), conf_.start_month(), conf_.start_day());
-  struct tm timeinfo = *localtime(&t);
+  // Jumps straight to the first day of the window, if any.
+  int days = getStartDays(0);
+  if (conf_.has_first_event_date()) {
+    int first_days = days_from_yyyymmdd(conf_.first_event_date());
+    if (first_days > days) {
+      bible_reading_plan.Skip(countReadingDaysBefore(first_days));
+      days = first_days;
+    }
+  }
+  const int last_days = conf_.has_last_event_date() ?
+    days_from_yyyymmdd(conf_.last_event_date()) : INT_MAX;
+
+  // When the calendar was created, in UTC, as every event needs it.
+  char dtstamp[32];
+  {
+    const time_t now = time(nullptr);
+    const int seconds_per_day = 24 * 60 * 60;
+    const int seconds = now % seconds_per_day;
+    CivilDate date = civil_from_days(now / seconds_per_day);
+    snprintf(dtstamp, sizeof(dtstamp), "%04d%02d%02dT%02d%02d%02dZ",
+        date.year, date.month, date.day,
+        seconds / 3600, seconds / 60 % 60, seconds % 60);
+  }
 
-  while (!bible_reading_plan.empty()) {
-    if (shouldInclude(timeinfo)) {
-      *ostream << "BEGIN:VEVENT" << std::endl;
+  // Reused for every event.
+  std::string text;
+  char value[64];
+  char end_value[16];
+
+  while (!bible_reading_plan.empty() && days <= last_days) {
+    if (shouldInclude(weekday_from_days(days))) {
+      ics.Property("BEGIN", "VEVENT");
 
       auto daily_reading = bible_reading_plan.PopFront();
 
-      *ostream << "SUMMARY:" <<
-        daily_reading.PrintSingleLine(conf_.language()) <<
-        std::endl;
+      text.clear();
+      daily_reading.AppendTo(conf_.language(), false, ", ", &text);
+      ics.TextProperty("SUMMARY", text);
 
-      *ostream << "DESCRIPTION:" <<
-        daily_reading.Print(conf_.language()) << std::endl;
+      text.clear();
+      daily_reading.AppendTo(conf_.language(), true, "\n", &text);
+      ics.TextProperty("DESCRIPTION", text);
 
-      char yyyymmdd[10];
-      strftime(yyyymmdd, 10, "%Y%m%d", &timeinfo);
-      *ostream << "DTSTART:" << yyyymmdd << std::endl;
-      *ostream << "DTEND:" << yyyymmdd << std::endl;
-      *ostream << "UID:" << yyyymmdd <<
-        "@biblereadingcalendar.com" << std::endl;
-    }
+      ics.Property("DTSTAMP", dtstamp);
 
-    *ostream << "END:VEVENT" << std::endl;
-    timeinfo = *get_next_day(&t);
+      // An all-day event, which ends at the start of the next day.
+      snprintf(value, sizeof(value), "%08d", yyyymmdd_from_days(days));
+      ics.Property("DTSTART;VALUE=DATE", value);
+      snprintf(end_value, sizeof(end_value), "%08d",
+          yyyymmdd_from_days(days + 1));
+      ics.Property("DTEND;VALUE=DATE", end_value);
+      strcat(value, "@biblereadingcalendar.com");
+      ics.Property("UID", value);
+
+      ics.Property("END", "VEVENT");
+    }
+    ++days;
   }
 
-  *ostream << "END:VCALENDAR" << std::endl;
-  return 200;
+  ics.Property("END", "VCALENDAR");
+  return ics.Finish() == CAIRO_STATUS_SUCCESS ? 200 : 500;
 }
@@ -19,73 +19,148 @@
 
 #include <config.pb.h>
 
-struct Book {
-  std::string short_name;
-  std::string full_name;
-};
+#include "civil_date.h"
+#include "text_cache.h"
 
 class ReadingPlan;
-
+class WorkerPool;
+struct PlanKey;
+
+// Renders the calendar of one configuration. A Calendar is not modified
+// after construction: the state of a render lives in a RenderContext on the
+// stack of the drawing thread, the plan tables are immutable and the text and
+// frame caches are per thread, and nothing from them is handed to another
+// thread. So any number of threads may render at once, from Calendars of
+// their own or from a shared one, and get the same bytes as one thread; the
+// render_stress test checks this.
 class Calendar {
   public:
     Calendar(config::CalendarConfig conf);
-    void draw();
-    void streamSvg(cairo_write_func_t writeFunc, void *closure);
-    void streamPng(cairo_write_func_t writeFunc, void *closure);
-    void streamPdf(cairo_write_func_t writeFunc, void *closure);
-    int iCalendar(std::ostream* ostream);
+    ~Calendar();
+    Calendar(const Calendar&) = delete;
+    Calendar& operator=(const Calendar&) = delete;
+
+    void draw() const;
+    int streamSvg(cairo_write_func_t writeFunc, void *closure) const;
+    int streamPng(cairo_write_func_t writeFunc, void *closure) const;
+    // The selected month as an image surface owned by the caller, before it
+    // is encoded by streamPng(). nullptr if the month is not in the plan.
+    cairo_surface_t* drawImage() const;
+    int streamPdf(cairo_write_func_t writeFunc, void *closure) const;
+    // Every month of the plan in one PNG, in rows of sprite_columns months,
+    // drawn in a single pass over the plan. 400 if it would be larger than
+    // --max_sprite_pixels.
+    int streamSprite(cairo_write_func_t writeFunc, void *closure) const;
+    int iCalendar(cairo_write_func_t writeFunc, void *closure) const;
+    // Appends the reading of |date|, as YYYYMMDD, to |json| in every
+    // language. Looks the day up arithmetically; nothing is drawn.
+    int dailyReadingJson(int date, std::string* json) const;
+
+    int countReadingMonths() const;
+
+    // Resolves the font of every text role in the font map of the calling
+    // thread, which otherwise happens on the first text drawn.
+    void loadFonts() const;
+
+    // The threads that draw the pages of PDFs, see --pdf_render_threads.
+    static WorkerPool& pagePool();
 
   private:
-    bool shouldInclude(const struct tm& tm);
+    enum TextRole {
+      MONTH_LABEL,
+      WDAY_LABEL,
+      DAY_NUMBER,
+      DAY_PLAN,
+      TEXT_ROLE_COUNT
+    };
+
+    // State of drawing one month onto one surface.
+    struct RenderContext {
+      cairo_t* cr;
+      // Top of what is still to be drawn.
+      double y_offset;
+      // Height of a week, known once the frame is drawn.
+      double cell_height;
+    };
+
+    // Resolves the font of each text role once per Calendar.
+    void initTextContext();
+    const TextCache::ShapedText& shapeText(const RenderContext& context,
+        TextRole role, const char* text) const;
+
+    bool shouldInclude(int wday) const;
 
-    int countDays(int year_index);
+    int getStartDays(int year_index) const;
 
-    void initMonthIteration(int* y, int* m);
-    bool isReadingMonth(int y, int m);
-    bool isSelectedMonth(int y, int m);
-    void nextMonth(int* y, int* m);
+    int countDays(int year_index) const;
+    PlanKey getPlanKey(int year_index) const;
+    int countPlanYears() const;
+    bool hasReadingPlan() const;
 
-    std::string getPlanFileName(int year_index);
+    void initMonthIteration(int* y, int* m) const;
+    bool isReadingMonth(int y, int m) const;
+    bool isSelectedMonthInPlan() const;
+    void nextMonth(int* y, int* m) const;
 
-    ReadingPlan getBibleReadingPlan();
-    void readPlanFile(const std::string file_name,
-        ReadingPlan* bible_reading_plan);
+    ReadingPlan getBibleReadingPlan() const;
 
-    double getDayX(int x_index);
-    double getDayY(int y_index);
+    // Applies conf_.quality() to |cr|.
+    void initContext(cairo_t* cr) const;
+    // A raster surface of conf_.scale() pixels per unit of the layout.
+    cairo_surface_t* createImageSurface() const;
+    int getPixelWidth() const;
+    int getPixelHeight() const;
 
-    void drawMonthLabel(int month);
+    double getDayX(int x_index) const;
+    double getDayY(const RenderContext& context, int y_index) const;
 
-    void drawWdayLabel();
+    void drawMonthLabel(RenderContext* context, int month) const;
 
-    void drawDaysOfMonth(int year, int month,
-        ReadingPlan* bible_reading_plan);
+    void drawWdayLabel(RenderContext* context) const;
 
-    void drawTextOfDayNumber(int x, int y,
-        const char* text);
+    void drawDaysOfMonth(const RenderContext& context, int year, int month,
+        ReadingPlan* bible_reading_plan) const;
 
-    void drawTextOfDayPlan(int x, int y, const
-        std::string text);
+    void drawTextOfDayNumber(const RenderContext& context, int x, int y,
+        const char* text) const;
 
-    void skipMonth(int year, int month,
-        ReadingPlan* bible_reading_plan);
+    void drawTextOfDayPlan(const RenderContext& context, int x, int y,
+        const std::string& text) const;
+
+    uint32_t countReadingDaysBefore(int year, int month) const;
+    // Reading days from the start of the plan up to the day number |days|.
+    uint32_t countReadingDaysBefore(int days) const;
 
     void drawMonth(int year, int month,
-        ReadingPlan* bible_reading_plan);
+        ReadingPlan* bible_reading_plan) const;
+
+    // Draws the static frame of a month with |weeks| weeks: the outer
+    // rectangle, the weekday labels and the grid.
+    void drawFrame(RenderContext* context, int weeks) const;
+    // Replays the frame recorded by drawFrame() for this layout, recording it
+    // on first use. Raster targets only; the frame is drawn afresh into
+    // vector ones.
+    void replayFrame(RenderContext* context, int weeks) const;
 
     void drawMonthOnSurface(int year, int month,
         ReadingPlan* bible_reading_plan,
-        cairo_surface_t* surface);
+        cairo_surface_t* surface) const;
 
-    void streamMonthOnSurface(cairo_surface_t* surface);
+    // Draws a month into a new recording surface owned by the caller.
+    cairo_surface_t* recordMonth(int year, int month,
+        ReadingPlan* bible_reading_plan) const;
+
+    void streamMonthOnSurface(cairo_surface_t* surface) const;
 
     static std::shared_ptr<spdlog::logger> logger_;
 
 
     config::CalendarConfig conf_;
+    RestDays rest_days_;
+
+    PangoFontDescription* font_descriptions_[TEXT_ROLE_COUNT];
+    std::string font_keys_[TEXT_ROLE_COUNT];
 
-    cairo_t *cr_;
-    double y_offset_;
     int surface_width_;
     int surface_height_;
 };
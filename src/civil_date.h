@@ -0,0 +1,114 @@
+#ifndef CIVIL_DATE_H_
+#define CIVIL_DATE_H_
+
+#include <stdint.h>
+
+// Proleptic Gregorian calendar arithmetic on day numbers, i.e. days since
+// 1970-01-01. Pure integer math: no time_t, no time zone, no libc state, so
+// it is safe to call from any thread and gives the same answer in any TZ.
+// The algorithms are from http://howardhinnant.github.io/date_algorithms.html
+
+struct CivilDate {
+  int year;
+  int month;  // 1..12
+  int day;    // 1..31
+};
+
+constexpr bool is_leap_year(int year)
+{
+  return year % 4 == 0 && (year % 100 != 0 || year % 400 == 0);
+}
+
+constexpr int days_in_month(int year, int month)
+{
+  constexpr int days_per_months[] = {
+    31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+  return month == 2 && is_leap_year(year) ? 29 : days_per_months[month - 1];
+}
+
+// Out-of-range days roll over linearly, e.g. Feb 29 of a common year is
+// Mar 1.
+constexpr int days_from_civil(int year, int month, int day)
+{
+  year -= month <= 2;
+  const int era = (year >= 0 ? year : year - 399) / 400;
+  const int yoe = year - era * 400;
+  const int doy = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 +
+    day - 1;
+  const int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + doe - 719468;
+}
+
+constexpr CivilDate civil_from_days(int days)
+{
+  days += 719468;
+  const int era = (days >= 0 ? days : days - 146096) / 146097;
+  const int doe = days - era * 146097;
+  const int yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  const int doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  const int mp = (5 * doy + 2) / 153;
+  const int day = doy - (153 * mp + 2) / 5 + 1;
+  const int month = mp < 10 ? mp + 3 : mp - 9;
+  return {yoe + era * 400 + (month <= 2), month, day};
+}
+
+// For dates written as YYYYMMDD, like the "s" parameter of requests.
+constexpr int days_from_yyyymmdd(int yyyymmdd)
+{
+  return days_from_civil(yyyymmdd / 10000, yyyymmdd / 100 % 100,
+      yyyymmdd % 100);
+}
+
+constexpr int yyyymmdd_from_days(int days)
+{
+  const CivilDate date = civil_from_days(days);
+  return date.year * 10000 + date.month * 100 + date.day;
+}
+
+// 0 for Sunday, matching struct tm's tm_wday and config::DayOfTheWeek.
+constexpr int weekday_from_days(int days)
+{
+  return days >= -4 ? (days + 4) % 7 : (days + 5) % 7 + 6;
+}
+
+// A set of weekdays, one bit per config::DayOfTheWeek.
+class RestDays {
+  public:
+    constexpr RestDays() : mask_(0) {}
+    constexpr explicit RestDays(uint8_t mask) : mask_(mask & 0x7f) {}
+
+    constexpr void Add(int wday) { mask_ |= 1 << wday; }
+    constexpr bool Contains(int wday) const { return mask_ >> wday & 1; }
+    constexpr uint8_t mask() const { return mask_; }
+
+    // Number of rest days among |days| consecutive days starting on
+    // |first_wday|.
+    constexpr int Count(int first_wday, int days) const
+    {
+      int count = 0;
+      for (int wday = 0; wday < 7; ++wday) {
+        if (Contains(wday)) {
+          count += days / 7;
+          if ((wday - first_wday + 7) % 7 < days % 7) {
+            ++count;
+          }
+        }
+      }
+      return count;
+    }
+
+  private:
+    uint8_t mask_;
+};
+
+static_assert(days_from_civil(1970, 1, 1) == 0, "epoch");
+static_assert(days_from_civil(2000, 3, 1) - days_from_civil(2000, 2, 28) == 2,
+    "leap day");
+static_assert(weekday_from_days(days_from_civil(2021, 1, 1)) == 5,
+    "2021-01-01 is a Friday");
+static_assert(civil_from_days(days_from_civil(2024, 2, 29)).day == 29,
+    "round trip");
+static_assert(yyyymmdd_from_days(days_from_yyyymmdd(20241231)) == 20241231,
+    "round trip");
+
+#endif  // CIVIL_DATE_H_
@@ -0,0 +1,141 @@
+#include <gflags/gflags.h>
+#include <pango/pangocairo.h>
+#include <pango/pangofc-fontmap.h>
+#include <sys/stat.h>
+
+#include "font_set.h"
+
+DEFINE_string(font_dir, "",
+    "If set, calendars are drawn only with the fonts in this directory, "
+    "instead of those of the system.");
+DEFINE_string(font_cache_dir, "",
+    "Where the index of --font_dir is cached, see --build_font_cache. If it "
+    "is not set or not writable, the cache of the user is used "
+    "($XDG_CACHE_HOME/bible-reading-calendar).");
+
+std::shared_ptr<spdlog::logger> FontSet::logger_ =
+  spdlog::stdout_color_mt("font_set");
+
+void FontSet::UseOnThisThread()
+{
+  thread_local bool used = false;
+  if (used) {
+    return;
+  }
+  used = true;
+
+  FcConfig* fc_config = config();
+  if (fc_config == nullptr) {
+    return;
+  }
+  PangoFontMap* font_map =
+    pango_cairo_font_map_new_for_font_type(CAIRO_FONT_TYPE_FT);
+  pango_fc_font_map_set_config(PANGO_FC_FONT_MAP(font_map), fc_config);
+  // Takes a reference of its own.
+  pango_cairo_font_map_set_default(PANGO_CAIRO_FONT_MAP(font_map));
+  g_object_unref(font_map);
+}
+
+bool FontSet::BuildCache()
+{
+  if (FLAGS_font_dir.empty()) {
+    logger_->error("No --font_dir to build the cache of");
+    return false;
+  }
+  FcConfig* fc_config = config();
+  if (fc_config == nullptr) {
+    logger_->error("No fonts to cache in [{}]", FLAGS_font_dir);
+    return false;
+  }
+  return isCached(fc_config);
+}
+
+FcConfig* FontSet::config()
+{
+  static FcConfig* fc_config = createConfig();
+  return fc_config;
+}
+
+FcConfig* FontSet::createConfig()
+{
+  if (FLAGS_font_dir.empty()) {
+    return nullptr;
+  }
+  // Deployments pass --font_dir whether or not fonts were installed there.
+  struct stat st;
+  if (stat(FLAGS_font_dir.c_str(), &st) != 0) {
+    logger_->info("No [{}], using the fonts of the system", FLAGS_font_dir);
+    return nullptr;
+  }
+
+  // Nothing of the configuration of the system is included. Fontconfig
+  // reads the index from any of the cache directories and writes it to the
+  // first writable one.
+  std::string conf = "<?xml version=\"1.0\"?><fontconfig><dir>" +
+    escapeXml(FLAGS_font_dir) + "</dir>";
+  if (!FLAGS_font_cache_dir.empty()) {
+    conf += "<cachedir>" + escapeXml(FLAGS_font_cache_dir) + "</cachedir>";
+  }
+  conf += "<cachedir prefix=\"xdg\">bible-reading-calendar</cachedir>"
+    "</fontconfig>";
+
+  FcConfig* fc_config = FcConfigCreate();
+  if (!FcConfigParseAndLoadFromMemory(fc_config,
+        (const FcChar8*) conf.c_str(), FcTrue) ||
+      !FcConfigBuildFonts(fc_config)) {
+    logger_->error("Failed to load the fonts of [{}], using the system's",
+        FLAGS_font_dir);
+    FcConfigDestroy(fc_config);
+    return nullptr;
+  }
+
+  FcFontSet* fonts = FcConfigGetFonts(fc_config, FcSetSystem);
+  if (fonts == nullptr || fonts->nfont == 0) {
+    logger_->error("No fonts in [{}], using the system's", FLAGS_font_dir);
+    FcConfigDestroy(fc_config);
+    return nullptr;
+  }
+  logger_->info("{} fonts in [{}]", fonts->nfont, FLAGS_font_dir);
+  if (!isCached(fc_config)) {
+    logger_->warn("Failed to cache the fonts of [{}], they are scanned at "
+        "every start", FLAGS_font_dir);
+  }
+  return fc_config;
+}
+
+bool FontSet::isCached(FcConfig* fc_config)
+{
+  FcChar8* cache_file = nullptr;
+  FcCache* cache = FcDirCacheLoad(
+      (const FcChar8*) FLAGS_font_dir.c_str(), fc_config, &cache_file);
+  if (cache == nullptr) {
+    return false;
+  }
+  logger_->debug("Fonts of [{}] cached in [{}]", FLAGS_font_dir,
+      (const char*) cache_file);
+  FcStrFree(cache_file);
+  FcDirCacheUnload(cache);
+  return true;
+}
+
+std::string FontSet::escapeXml(const std::string& text)
+{
+  std::string escaped;
+  for (char c : text) {
+    switch (c) {
+      case '&':
+        escaped += "&amp;";
+        break;
+      case '<':
+        escaped += "&lt;";
+        break;
+      case '>':
+        escaped += "&gt;";
+        break;
+      default:
+        escaped += c;
+        break;
+    }
+  }
+  return escaped;
+}
@@ -0,0 +1,42 @@
+#ifndef FONT_SET_H_
+#define FONT_SET_H_
+
+#include <fontconfig/fontconfig.h>
+#include <spdlog/spdlog.h>
+#include <spdlog/sinks/stdout_color_sinks.h>
+#include <string>
+
+// The fonts calendars are drawn with. By default Pango resolves families
+// through the fontconfig configuration of the system, which indexes every
+// font of the host and makes the output depend on what is installed there.
+// With --font_dir only the fonts shipped in that directory are known: they
+// are indexed once into a private fontconfig configuration, whose cache in
+// --font_cache_dir lets later starts skip the scan, and the font map of
+// every drawing thread resolves families through it.
+class FontSet {
+  public:
+    // Points the default Pango font map of the calling thread at --font_dir.
+    // Must run before the thread first uses Pango; later calls are no-ops,
+    // and so is every call without --font_dir.
+    static void UseOnThisThread();
+
+    // Indexes --font_dir and writes its cache, as done once at install time
+    // so that the server does not scan the fonts when it starts. False if
+    // there are no fonts or the cache could not be written.
+    static bool BuildCache();
+
+  private:
+    // The configuration of --font_dir shared by all threads, built on first
+    // use. nullptr if the system configuration is used.
+    static FcConfig* config();
+    static FcConfig* createConfig();
+    // Whether the index of --font_dir is in one of the cache directories of
+    // fc_config, where fontconfig writes it after scanning if it can.
+    static bool isCached(FcConfig* fc_config);
+
+    static std::string escapeXml(const std::string& text);
+
+    static std::shared_ptr<spdlog::logger> logger_;
+};
+
+#endif  // FONT_SET_H_
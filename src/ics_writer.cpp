@@ -0,0 +1,107 @@
+#include <string.h>
+
+#include "ics_writer.h"
+
+namespace {
+
+// Length of the UTF-8 sequence starting with |c|.
+size_t sequence_length(unsigned char c)
+{
+  if (c < 0xc0) return 1;
+  if (c < 0xe0) return 2;
+  if (c < 0xf0) return 3;
+  return 4;
+}
+
+} // namespace
+
+IcsWriter::IcsWriter(cairo_write_func_t write_func, void* closure) :
+  write_func_(write_func), closure_(closure)
+{
+}
+
+void IcsWriter::Property(const char* name, const char* value)
+{
+  beginLine(name);
+  for (const char* p = value; *p; ) {
+    size_t length = sequence_length(*p);
+    append(p, length);
+    p += length;
+  }
+  endLine();
+}
+
+void IcsWriter::TextProperty(const char* name, const std::string& value)
+{
+  beginLine(name);
+  for (size_t i = 0; i < value.size(); ) {
+    switch (value[i]) {
+      case '\\':
+        append("\\\\", 2);
+        break;
+      case ';':
+        append("\\;", 2);
+        break;
+      case ',':
+        append("\\,", 2);
+        break;
+      case '\n':
+        append("\\n", 2);
+        break;
+      default:
+        size_t length = sequence_length(value[i]);
+        append(value.data() + i, length);
+        i += length;
+        continue;
+    }
+    ++i;
+  }
+  endLine();
+}
+
+cairo_status_t IcsWriter::Finish()
+{
+  flush();
+  return status_;
+}
+
+void IcsWriter::beginLine(const char* name)
+{
+  line_octets_ = 0;
+  append(name, strlen(name));
+  append(":", 1);
+}
+
+void IcsWriter::endLine()
+{
+  put("\r\n", 2);
+}
+
+void IcsWriter::append(const char* data, size_t length)
+{
+  if (line_octets_ + length > kMaxLineOctets) {
+    // The leading space of the continuation line counts.
+    put("\r\n ", 3);
+    line_octets_ = 1;
+  }
+  put(data, length);
+  line_octets_ += length;
+}
+
+void IcsWriter::put(const char* data, size_t length)
+{
+  if (buffer_size_ + length > kBufferBytes) {
+    flush();
+  }
+  memcpy(buffer_ + buffer_size_, data, length);
+  buffer_size_ += length;
+}
+
+void IcsWriter::flush()
+{
+  if (buffer_size_ > 0 && status_ == CAIRO_STATUS_SUCCESS) {
+    status_ = write_func_(closure_,
+        (const unsigned char*) buffer_, buffer_size_);
+  }
+  buffer_size_ = 0;
+}
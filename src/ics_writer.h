@@ -0,0 +1,46 @@
+#ifndef ICS_WRITER_H_
+#define ICS_WRITER_H_
+
+#include <cairo.h>
+#include <string>
+
+// Serializes iCalendar (RFC 5545) content lines: CRLF line endings, TEXT
+// escaping and folding of lines longer than 75 octets without splitting
+// UTF-8 sequences. Output is collected in a fixed buffer and handed to
+// |write_func| only when the buffer is full, or on Finish().
+class IcsWriter {
+  public:
+    IcsWriter(cairo_write_func_t write_func, void* closure);
+    IcsWriter(const IcsWriter&) = delete;
+    IcsWriter& operator=(const IcsWriter&) = delete;
+
+    // Writes "|name|:|value|" where |value| is already valid iCalendar.
+    void Property(const char* name, const char* value);
+    // Writes "|name|:|value|" escaping |value| as TEXT.
+    void TextProperty(const char* name, const std::string& value);
+
+    // Writes out what is buffered. Returns the first error of |write_func|.
+    cairo_status_t Finish();
+
+  private:
+    static const size_t kBufferBytes = 64 << 10;
+    static const size_t kMaxLineOctets = 75;
+
+    void beginLine(const char* name);
+    void endLine();
+    // Appends |length| octets forming whole UTF-8 sequences to the line,
+    // folding it first if they would not fit.
+    void append(const char* data, size_t length);
+    void put(const char* data, size_t length);
+    void flush();
+
+    cairo_write_func_t write_func_;
+    void* closure_;
+    cairo_status_t status_ = CAIRO_STATUS_SUCCESS;
+
+    char buffer_[kBufferBytes];
+    size_t buffer_size_ = 0;
+    size_t line_octets_ = 0;
+};
+
+#endif  // ICS_WRITER_H_
@@ -1,4 +1,5 @@
 #include <cairo.h>
+#include <chrono>
 #include <fcntl.h>
 #include <fstream>
 #include <gflags/gflags.h>
@@ -14,6 +15,18 @@
 
 #include "calendar.h"
 #include "config.pb.h"
+#include "font_set.h"
+#include "png_encoder.h"
+#include "reading_plan.h"
+
+DEFINE_int32(benchmark_png, 0,
+    "If positive, draws the month in the config once, encodes it this many "
+    "times as a PNG of each color type and prints the sizes and encoding "
+    "times instead of drawing the calendar.");
+DEFINE_bool(list_fonts, false,
+    "Lists the font families that calendars can be drawn with, which are "
+    "those of --font_dir if it is set, instead of drawing the calendar.");
+DECLARE_string(png_color);
 
 auto console = spdlog::stdout_color_mt("main");
 
@@ -40,6 +53,7 @@ bool parse_config(config::CalendarConfig *conf) {
 
 void list_fonts()
 {
+  FontSet::UseOnThisThread();
   PangoFontMap * fontmap = pango_cairo_font_map_get_default();
 
   PangoFontFamily **families;
@@ -65,15 +79,71 @@ void list_fonts()
   g_free(families);
 }
 
+cairo_status_t count_bytes(
+    void* closure, const unsigned char* data, unsigned int length)
+{
+  *(size_t*) closure += length;
+  return CAIRO_STATUS_SUCCESS;
+}
+
+// Compares the size and encoding time of each --png_color, with the other
+// --png_* flags as given. The month is drawn once, so only the encoder is
+// timed, and every color type is encoded once untimed first, so that none
+// of them pays for warming up.
+void benchmark_png(const config::CalendarConfig& conf)
+{
+  Calendar calendar(conf);
+  cairo_surface_t* surface = calendar.drawImage();
+  if (surface == nullptr) {
+    console->error("{}-{} is not in the reading plan!",
+        conf.year(), conf.month());
+    return;
+  }
+
+  const char* colors[] = {"rgba", "gray", "gray4"};
+  for (const char* color : colors) {
+    FLAGS_png_color = color;
+    size_t bytes = 0;
+    PngEncoder::Write(surface, count_bytes, &bytes);
+  }
+
+  for (const char* color : colors) {
+    FLAGS_png_color = color;
+    size_t bytes = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < FLAGS_benchmark_png; ++i) {
+      bytes = 0;
+      PngEncoder::Write(surface, count_bytes, &bytes);
+    }
+    std::chrono::duration<double, std::milli> elapsed =
+      std::chrono::steady_clock::now() - start;
+    std::cout << std::setw(5) << color << ": " << bytes << " bytes, " <<
+      elapsed.count() / FLAGS_benchmark_png << " ms" << std::endl;
+  }
+  cairo_surface_destroy(surface);
+}
+
 int main(int argc, char *argv[])
 {
   gflags::ParseCommandLineFlags(&argc, &argv, true);
 
+  if (FLAGS_list_fonts) {
+    list_fonts();
+    return EXIT_SUCCESS;
+  }
+
   config::CalendarConfig conf;
   if (!parse_config(&conf)) {
     console->error("Config parsing error");
     return EXIT_FAILURE;
   }
+  PlanRegistry::Load();
+
+  if (FLAGS_benchmark_png > 0) {
+    benchmark_png(conf);
+    return EXIT_SUCCESS;
+  }
+
   Calendar calendar(std::move(conf));
   calendar.draw();
   return EXIT_SUCCESS;
@@ -1,26 +1,109 @@
+#include <booster/shared_ptr.h>
 #include <cppcms/application.h>
 #include <cppcms/applications_pool.h>
+#include <cppcms/http_context.h>
 #include <cppcms/http_response.h>
 #include <cppcms/http_request.h>
 #include <cppcms/service.h>
 #include <cppcms/url_dispatcher.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
 #include <fstream>
+#include <functional>
 #include <gflags/gflags.h>
 #include <iostream>
+#include <map>
+#include <mutex>
+#include <set>
+#include <sstream>
 #include <time.h>
+#include <vector>
 
+#include "build_version.h"
 #include "calendar.h"
+#include "civil_date.h"
 #include "config.pb.h"
+#include "font_set.h"
+#include "reading_plan.h"
+#include "render_cache.h"
+#include "response_sink.h"
+#include "single_flight.h"
+#include "worker_pool.h"
+
+DEFINE_uint64(response_flush_bytes, 0,
+    "If positive, bodies rendered on the request thread are streamed to the "
+    "client whenever this many bytes are pending. Otherwise each body is "
+    "sent in one write with a Content-Length.");
+DEFINE_int32(render_threads, 4,
+    "Threads rendering SVG, PNG and ICS responses off the request threads. "
+    "0 renders them on the request thread.");
+DEFINE_int32(pdf_threads, 2,
+    "Threads rendering PDF responses, apart from the others so that slow "
+    "PDFs never hold them up. 0 renders them on the request thread.");
+DEFINE_uint64(render_queue_depth, 64,
+    "SVG, PNG and ICS renders that may wait for a thread before further "
+    "requests are turned away with 503.");
+DEFINE_uint64(pdf_queue_depth, 8,
+    "PDF renders that may wait for a thread before further requests are "
+    "turned away with 503.");
+DEFINE_int32(retry_after_seconds, 5,
+    "Retry-After of requests turned away because too many renders wait.");
+DEFINE_bool(warm_up, true,
+    "Before serving, resolve the fonts on every render thread and render the "
+    "previews and PDFs of the default plans of the builder page, starting "
+    "today and next month, into the render cache.");
+DEFINE_bool(build_font_cache, false,
+    "Writes the cache of --font_dir to --font_cache_dir and exits, instead "
+    "of serving. Run once at install time so that starts skip the font scan.");
 
 auto logger = spdlog::stdout_color_mt("main");
 
+// Months per row of /sprite.png.
+const int kSpriteColumns = 4;
+
+// Largest "days" of /c.ics, which is more than any plan.
+const int kMaxWindowDays = 800;
+
+// Query parameters of the plans that the builder page selects by default,
+// which most visitors keep. See --warm_up.
+const std::vector<std::map<std::string, std::string>> kDefaultPlans = {
+  {{"c", "new-testament"}, {"r1", "sunday"}, {"r2", "saturday"}},
+  {{"c", "old-testament"}, {"d", "one-year"}, {"r", "everyday"}},
+  {{"c", "whole-bible"}, {"d", "one-year"}, {"o", "old-testament-first"},
+    {"r", "everyday"}},
+  {{"c", "new-testament-and-psalms"}, {"r", "everyday"}},
+};
+
+// Locales of the builder page.
+const char* const kLanguages[] = {"en-US", "ko"};
+
+// Offsets from UTC, in hours, of the dates that the builder page is opened
+// on: UTC, and Korea Standard Time for its Korean visitors.
+const int kUtcOffsetHours[] = {0, 9};
+
+// Scales of raster output, from thumbnails to HiDPI screens. Requested
+// scales are rounded up to one of these, so that they share cache entries.
+const double kScaleTiers[] = {0.25, 0.5, 1, 2, 3};
+
+// Largest scale of /sprite.png, whose months are thumbnails. Months in full
+// size come from /img.png one at a time.
+const double kMaxSpriteScale = 0.5;
+
+// Looks up a query parameter by name, empty if it is missing.
+typedef std::function<std::string(const std::string&)> Params;
+
 class CalendarApp : public cppcms::application {
   public:
     CalendarApp(cppcms::service &srv) : cppcms::application(srv) {
       dispatcher().assign("/img.svg", &CalendarApp::svg, this);
       dispatcher().assign("/img.pdf", &CalendarApp::pdf, this);
       dispatcher().assign("/img.png", &CalendarApp::png, this);
+      dispatcher().assign("/sprite.png", &CalendarApp::sprite, this);
       dispatcher().assign("/c.ics", &CalendarApp::ics, this);
+      dispatcher().assign("/today.json", &CalendarApp::today, this);
+      dispatcher().assign("/day.json", &CalendarApp::day, this);
+      dispatcher().assign("/stats.json", &CalendarApp::stats, this);
       dispatcher().assign(".*", &CalendarApp::redirect, this);
     }
 
@@ -38,34 +121,32 @@ class CalendarApp : public cppcms::application {
     void svg();
     void pdf();
     void png();
+    void sprite();
     void ics();
-
-    static cairo_status_t cairoWriteFunc(
-        void* closure, const unsigned char* data, unsigned int length) {
-      auto& ostream = ((CalendarApp*)closure)->response().out();
-      ostream.write((const char*)data, length);
-      ostream.flush();
-      return CAIRO_STATUS_SUCCESS;
-    }
-
-    static cairo_status_t cairoWriteToMemoryFunc(
-        void* closure, const unsigned char* data, unsigned int length) {
-      ((CalendarApp*)closure)->writeToCairoBuffer(data, length);
-      return CAIRO_STATUS_SUCCESS;
-    }
-
-    void writeToCairoBuffer(
-        const unsigned char* data, unsigned int length) {
-      memcpy(cairoBuffer_ + cairoBufferOffset_, data, length);
-      cairoBufferOffset_ += length;
-    }
+    void today();
+    void day();
+    void stats();
 
   private:
-    config::CalendarConfig buildConfig();
+    // Builds the config of the current request into |conf|. Answers 404 and
+    // returns false if the coverage is unknown.
+    bool buildConfig(config::CalendarConfig* conf);
+    // Reads the scale ("x") and quality ("q") of raster output.
+    void setRasterOptions(config::CalendarConfig* conf);
+    // Looks up the query parameters of the current request.
+    Params params();
     void initResponse();
-
-    unsigned char* cairoBuffer_;
-    unsigned int cairoBufferOffset_;
+    // |exists| tells whether the body for |etag| is known to be renderable,
+    // which "If-None-Match: *" asks about.
+    bool isNotModified(const std::string& etag, bool exists);
+    // Writes the cached body for |conf|, or renders it with |render| and
+    // caches it. Renders run on the pool of their output type and complete
+    // the response asynchronously.
+    void serve(const config::CalendarConfig& conf,
+        std::function<int(ResponseSink*)> render);
+    void renderHere(const std::string& key, const std::string& etag,
+        const std::function<int(ResponseSink*)>& render);
+    void serveDailyReading(int date);
 };
 
 config::DayOfTheWeek getDayOfTheWeekType(const std::string& d)
@@ -90,93 +171,148 @@ config::DurationType getDurationType(const std::string& d)
   return config::DurationType::TWO_YEARS;
 }
 
-config::CalendarConfig CalendarApp::buildConfig()
+// Parses a YYYYMMDD parameter. Returns false if it is missing or invalid.
+bool parseDate(const std::string& param, int* yyyymmdd)
 {
-  config::CalendarConfig conf;
+  if (param.size() != 8 ||
+      param.find_first_not_of("0123456789") != std::string::npos) {
+    return false;
+  }
+  int value = stoi(param);
+  int month = value / 100 % 100;
+  int day = value % 100;
+  if (month < 1 || month > 12 || day < 1 ||
+      day > days_in_month(value / 10000, month)) {
+    return false;
+  }
+  *yyyymmdd = value;
+  return true;
+}
 
-  const auto& c = request().get("c");
+// Builds the config that the query |params| describe. Returns false if the
+// coverage is unknown.
+bool buildConfig(const Params& params, config::CalendarConfig* conf)
+{
+  bool known = true;
+  const auto& c = params("c");
   if (c == "new-testament") {
-    conf.set_coverage_type(config::CoverageType::NEW_TESTAMENT);
-    conf.add_days_to_rest(getDayOfTheWeekType(request().get("r1")));
-    conf.add_days_to_rest(getDayOfTheWeekType(request().get("r2")));
+    conf->set_coverage_type(config::CoverageType::NEW_TESTAMENT);
+    conf->add_days_to_rest(getDayOfTheWeekType(params("r1")));
+    conf->add_days_to_rest(getDayOfTheWeekType(params("r2")));
   } else if (c == "old-testament") {
-    conf.set_coverage_type(config::CoverageType::OLD_TESTAMENT);
-    conf.set_duration_type(getDurationType(request().get("d")));
-    if (hasRestDay(request().get("r"))) {
-      conf.add_days_to_rest(getDayOfTheWeekType(request().get("r")));
+    conf->set_coverage_type(config::CoverageType::OLD_TESTAMENT);
+    conf->set_duration_type(getDurationType(params("d")));
+    if (hasRestDay(params("r"))) {
+      conf->add_days_to_rest(getDayOfTheWeekType(params("r")));
     }
   } else if (c == "whole-bible") {
-    conf.set_duration_type(getDurationType(request().get("d")));
-    if (hasRestDay(request().get("r"))) {
-      conf.add_days_to_rest(getDayOfTheWeekType(request().get("r")));
+    conf->set_duration_type(getDurationType(params("d")));
+    if (hasRestDay(params("r"))) {
+      conf->add_days_to_rest(getDayOfTheWeekType(params("r")));
     }
 
-    const auto& o = request().get("o");
+    const auto& o = params("o");
     if (o == "old-testament-first") {
-      conf.set_coverage_type(config::CoverageType::WHOLE_BIBLE);
+      conf->set_coverage_type(config::CoverageType::WHOLE_BIBLE);
     } else if (o == "new-testament-first") {
-      conf.set_coverage_type(
+      conf->set_coverage_type(
           config::CoverageType::WHOLE_BIBLE_NEW_TESTAMENT_FIRST);
     } else {
-      conf.set_coverage_type(config::CoverageType::WHOLE_BIBLE_IN_PARALLEL);
+      conf->set_coverage_type(config::CoverageType::WHOLE_BIBLE_IN_PARALLEL);
     }
   } else if (c == "new-testament-and-psalms") {
-    conf.set_coverage_type(config::CoverageType::NEW_TESTAMENT_AND_PSALMS);
+    conf->set_coverage_type(config::CoverageType::NEW_TESTAMENT_AND_PSALMS);
 
-    if (hasRestDay(request().get("r"))) {
-      conf.add_days_to_rest(getDayOfTheWeekType(request().get("r")));
+    if (hasRestDay(params("r"))) {
+      conf->add_days_to_rest(getDayOfTheWeekType(params("r")));
     }
   } else {
-    response().status(404);
+    known = false;
+  }
+  // Only images of a single month need these.
+  if (!params("y").empty()) {
+    conf->set_year(stoi(params("y")));
+  }
+  if (!params("m").empty()) {
+    conf->set_month(stoi(params("m")));
   }
-  conf.set_year(stoi(request().get("y")));
-  // TODO: ignore 'i' parameter when rendering PDF
-  conf.set_month(stoi(request().get("m")));
 
   // Parse YYYYMMDD
-  long s = stol(request().get("s"));
-  conf.set_start_day(s % 100);
+  long s = stol(params("s"));
+  conf->set_start_day(s % 100);
   s /= 100;
-  conf.set_start_month(s % 100);
-  conf.set_start_year(s / 100);
+  conf->set_start_month(s % 100);
+  conf->set_start_year(s / 100);
 
-  if (request().get("l") == "ko") {
-    conf.set_language(config::Language::KOREAN);
-    conf.set_paper_type(config::PaperType::A4);
+  if (params("l") == "ko") {
+    conf->set_language(config::Language::KOREAN);
+    conf->set_paper_type(config::PaperType::A4);
 
-    conf.set_default_font_family("Gothic A1");
+    conf->set_default_font_family("Gothic A1");
 
-    conf.set_margin_top(25);
-    conf.set_month_label_font_family("Gothic A1 ExtraBold");
-    conf.set_month_label_font_size(100);
+    conf->set_margin_top(25);
+    conf->set_month_label_font_family("Gothic A1 ExtraBold");
+    conf->set_month_label_font_size(100);
 
-    conf.set_wday_label_font_family("Gothic A1 Bold");
-    conf.set_wday_label_font_size(18);
+    conf->set_wday_label_font_family("Gothic A1 Bold");
+    conf->set_wday_label_font_size(18);
 
-    conf.set_day_number_font_family("Mulish Bold");
-    conf.set_day_number_font_size(28);
+    conf->set_day_number_font_family("Mulish Bold");
+    conf->set_day_number_font_size(28);
 
-    conf.set_day_plan_font_size(20);
+    conf->set_day_plan_font_size(20);
   } else {
-    conf.set_language(config::Language::ENGLISH);
-    conf.set_paper_type(config::PaperType::US_LETTER);
+    conf->set_language(config::Language::ENGLISH);
+    conf->set_paper_type(config::PaperType::US_LETTER);
 
-    conf.set_default_font_family("Roboto");
+    conf->set_default_font_family("Roboto");
 
-    conf.set_margin_top(-10);
-    conf.set_month_label_font_family("Playfair Display");
-    conf.set_month_label_font_size(90);
+    conf->set_margin_top(-10);
+    conf->set_month_label_font_family("Playfair Display");
+    conf->set_month_label_font_size(90);
 
-    conf.set_wday_label_font_family("Roboto Medium");
-    conf.set_wday_label_font_size(20);
+    conf->set_wday_label_font_family("Roboto Medium");
+    conf->set_wday_label_font_size(20);
 
-    conf.set_day_number_font_size(28);
+    conf->set_day_number_font_size(28);
 
-    conf.set_day_plan_font_family("BarlowCondensed");
-    conf.set_day_plan_font_size(23);
+    conf->set_day_plan_font_family("BarlowCondensed");
+    conf->set_day_plan_font_size(23);
   }
 
-  return conf;
+  return known;
+}
+
+bool CalendarApp::buildConfig(config::CalendarConfig* conf)
+{
+  if (!::buildConfig(params(), conf)) {
+    response().status(404);
+    return false;
+  }
+  return true;
+}
+
+void CalendarApp::setRasterOptions(config::CalendarConfig* conf)
+{
+  const auto& x = request().get("x");
+  if (!x.empty()) {
+    double scale = atof(x.c_str());
+    for (double tier : kScaleTiers) {
+      conf->set_scale(tier);
+      if (scale <= tier) {
+        break;
+      }
+    }
+  }
+  if (request().get("q") == "fast") {
+    conf->set_quality(config::RenderQuality::FAST);
+  }
+}
+
+Params CalendarApp::params()
+{
+  cppcms::http::request* request = &this->request();
+  return [request](const std::string& name) { return request->get(name); };
 }
 
 void CalendarApp::initResponse()
@@ -184,13 +320,236 @@ void CalendarApp::initResponse()
   response().cache_control("public, max-age=3600");
 }
 
+// cppcms may gzip text bodies, so they are sent without Content-Length and
+// their validators are weak.
+bool isText(cppcms::http::response& response)
+{
+  return response.get_header("Content-Type").compare(0, 5, "text/") == 0;
+}
+
+// A validator for the body rendered from the config with |key|, weak if the
+// body may be sent compressed or not.
+std::string getETag(const std::string& key, bool weak)
+{
+  std::hash<std::string> hash;
+  size_t h = hash(key);
+  h = h * 31 + PlanRegistry::Get().version();
+  h = h * 31 + hash(kBuildVersion);
+
+  char etag[24];
+  snprintf(etag, sizeof(etag), "%s\"%016zx\"", weak ? "W/" : "", h);
+  return etag;
+}
+
+bool CalendarApp::isNotModified(const std::string& etag, bool exists)
+{
+  const std::string if_none_match = request().getenv("HTTP_IF_NONE_MATCH");
+  if (if_none_match.empty()) {
+    return false;
+  }
+
+  // If-None-Match uses the weak comparison, which ignores "W/".
+  const std::string opaque_tag =
+    etag.rfind("W/", 0) == 0 ? etag.substr(2) : etag;
+
+  std::istringstream iss(if_none_match);
+  std::string tag;
+  while (std::getline(iss, tag, ',')) {
+    tag.erase(0, tag.find_first_not_of(" \t"));
+    tag.erase(tag.find_last_not_of(" \t") + 1);
+    if (tag.rfind("W/", 0) == 0) {
+      tag.erase(0, 2);
+    }
+    if (tag == "*" ? exists : tag == opaque_tag) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Sends |body| with Content-Length, unless it is text which cppcms may
+// compress.
+void writeBody(cppcms::http::response& response, const std::string& etag,
+    const std::string& body)
+{
+  if (!isText(response)) {
+    response.io_mode(cppcms::http::response::nogzip);
+    response.content_length(body.size());
+  }
+  response.set_header("ETag", etag);
+  response.out().write(body.data(), body.size());
+}
+
+// Answers with a render that failed or was turned away. Unlike bodies, these
+// must not be kept by shared caches for the max-age of initResponse(): a 503
+// would outlive its Retry-After.
+void setErrorStatus(cppcms::http::response& response, int status)
+{
+  response.status(status);
+  response.cache_control("no-store");
+  if (status == 503) {
+    response.set_header("Retry-After",
+        std::to_string(FLAGS_retry_after_seconds));
+  }
+}
+
+// Renders into |sink| and caches the body.
+SingleFlight::Result renderBody(const std::string& key,
+    const std::function<int(ResponseSink*)>& render, ResponseSink* sink)
+{
+  SingleFlight::Result result = {render(sink), nullptr};
+  if (result.status == 200) {
+    sink->Flush();
+    result.body = std::make_shared<const std::string>(sink->Release());
+    RenderCache::Get().Insert(key, result.body);
+  }
+  return result;
+}
+
+WorkerPool& renderPool()
+{
+  static WorkerPool pool(std::max(FLAGS_render_threads, 0));
+  return pool;
+}
+
+WorkerPool& pdfPool()
+{
+  static WorkerPool pool(std::max(FLAGS_pdf_threads, 0));
+  return pool;
+}
+
+void CalendarApp::serve(const config::CalendarConfig& conf,
+    std::function<int(ResponseSink*)> render)
+{
+  const std::string key = RenderCache::Key(conf);
+  const std::string etag = getETag(key, isText(response()));
+  // Only bodies that rendered are cached, so a cached body is the only sign
+  // that "*" matches.
+  std::shared_ptr<const std::string> body = RenderCache::Get().Find(key);
+  if (isNotModified(etag, body != nullptr)) {
+    response().set_header("ETag", etag);
+    response().status(304);
+    return;
+  }
+
+  if (body) {
+    writeBody(response(), etag, *body);
+    return;
+  }
+
+  const bool pdf = conf.output_type() == config::OutputType::PDF;
+  WorkerPool& pool = pdf ? pdfPool() : renderPool();
+  if (pool.size() == 0) {
+    renderHere(key, etag, render);
+    return;
+  }
+
+  // The request thread is free for the next request once the context is
+  // released. The application object may serve other requests meanwhile,
+  // so nothing below captures it.
+  booster::shared_ptr<cppcms::http::context> context = release_context();
+  cppcms::service* srv = &service();
+  auto done = [context, srv, etag](const SingleFlight::Result& result) {
+    // The context belongs to the event loop.
+    srv->post([context, etag, result]() {
+      if (result.status == 200) {
+        writeBody(context->response(), etag, *result.body);
+      } else {
+        setErrorStatus(context->response(), result.status);
+      }
+      context->async_complete_response();
+    });
+  };
+
+  // Identical requests arriving while the body renders wait for that render
+  // without a thread or a place in the queue.
+  if (!SingleFlight::Get().Join(key, done)) {
+    return;
+  }
+
+  const size_t queued = pool.queued();
+  if (queued >= (pdf ? FLAGS_pdf_queue_depth : FLAGS_render_queue_depth)) {
+    logger->warn("Turning a request away, {} renders are waiting", queued);
+    SingleFlight::Get().Land(key, {503, nullptr});
+    return;
+  }
+
+  pool.Post([key, render]() {
+    SingleFlight::Result result = {500, nullptr};
+    try {
+      // Rendered by a flight that landed between the lookup on the request
+      // thread and Join().
+      result.body = RenderCache::Get().Find(key);
+      if (result.body) {
+        result.status = 200;
+      } else {
+        ResponseSink sink;
+        result = renderBody(key, render, &sink);
+      }
+    } catch (const std::exception& e) {
+      logger->error(e.what());
+    }
+    SingleFlight::Get().Land(key, result);
+  });
+}
+
+void CalendarApp::renderHere(const std::string& key, const std::string& etag,
+    const std::function<int(ResponseSink*)>& render)
+{
+  const bool streaming = FLAGS_response_flush_bytes > 0;
+  bool leader;
+  SingleFlight::Result result = SingleFlight::Get().Do(key, [&]() {
+    ResponseSink sink(streaming ? &response().out() : nullptr,
+        FLAGS_response_flush_bytes);
+    if (streaming) {
+      // Headers go out with the first bytes.
+      response().set_header("ETag", etag);
+    }
+    return renderBody(key, render, &sink);
+  }, &leader);
+
+  if (result.status != 200) {
+    setErrorStatus(response(), result.status);
+    return;
+  }
+  if (!leader || !streaming) {
+    writeBody(response(), etag, *result.body);
+  }
+}
+
+void setPdfOptions(config::CalendarConfig* conf)
+{
+  conf->set_output_type(config::OutputType::PDF);
+  // Every month of the plan is in the PDF.
+  conf->clear_year();
+  conf->clear_month();
+}
+
+// After the raster options, which it bounds.
+void setSpriteOptions(config::CalendarConfig* conf)
+{
+  conf->set_output_type(config::OutputType::PNG);
+  conf->set_sprite_columns(kSpriteColumns);
+  conf->set_scale(std::min(conf->scale(), kMaxSpriteScale));
+  // Every month of the plan is in the sprite.
+  conf->clear_year();
+  conf->clear_month();
+}
+
 void CalendarApp::svg()
 {
   initResponse();
   response().set_header("Content-Type", "image/svg+xml");
 
-  Calendar calendar(buildConfig());
-  calendar.streamSvg(CalendarApp::cairoWriteFunc, this);
+  config::CalendarConfig conf;
+  if (!buildConfig(&conf)) {
+    return;
+  }
+  conf.set_output_type(config::OutputType::SVG);
+  serve(conf, [conf](ResponseSink* body) {
+    Calendar calendar(conf);
+    return calendar.streamSvg(ResponseSink::Write, body);
+  });
 }
 
 void CalendarApp::pdf()
@@ -198,8 +557,15 @@ void CalendarApp::pdf()
   initResponse();
   response().set_header("Content-Type", "application/pdf");
 
-  Calendar calendar(buildConfig());
-  calendar.streamPdf(CalendarApp::cairoWriteFunc, this);
+  config::CalendarConfig conf;
+  if (!buildConfig(&conf)) {
+    return;
+  }
+  setPdfOptions(&conf);
+  serve(conf, [conf](ResponseSink* body) {
+    Calendar calendar(conf);
+    return calendar.streamPdf(ResponseSink::Write, body);
+  });
 }
 
 void CalendarApp::png()
@@ -207,21 +573,255 @@ void CalendarApp::png()
   initResponse();
   response().set_header("Content-Type", "image/png");
 
-  Calendar calendar(buildConfig());
-  calendar.streamPng(CalendarApp::cairoWriteFunc, this);
+  config::CalendarConfig conf;
+  if (!buildConfig(&conf)) {
+    return;
+  }
+  conf.set_output_type(config::OutputType::PNG);
+  setRasterOptions(&conf);
+  serve(conf, [conf](ResponseSink* body) {
+    Calendar calendar(conf);
+    return calendar.streamPng(ResponseSink::Write, body);
+  });
+}
+
+// All the months of the preview in one image, so that one preview costs one
+// request and one pass over the plan. The months are tiled left to right in
+// rows of X-Sprite-Columns, X-Sprite-Months in total.
+void CalendarApp::sprite()
+{
+  initResponse();
+  response().set_header("Content-Type", "image/png");
+
+  config::CalendarConfig conf;
+  if (!buildConfig(&conf)) {
+    return;
+  }
+  setRasterOptions(&conf);
+  setSpriteOptions(&conf);
+
+  response().set_header("X-Sprite-Columns", std::to_string(kSpriteColumns));
+  response().set_header("X-Sprite-Months",
+      std::to_string(Calendar(conf).countReadingMonths()));
+  serve(conf, [conf](ResponseSink* body) {
+    Calendar calendar(conf);
+    return calendar.streamSprite(ResponseSink::Write, body);
+  });
 }
 
 void CalendarApp::ics()
 {
   initResponse();
-  auto& ostream = response().out();
   response().set_header("Content-Type", "text/calendar");
 
-  Calendar calendar(buildConfig());
-  int status = calendar.iCalendar(&ostream);
+  config::CalendarConfig conf;
+  if (!buildConfig(&conf)) {
+    return;
+  }
+  conf.set_output_type(config::OutputType::ICS);
+  // Every day of the plan is in the calendar, unless subscribers ask for a
+  // window: "from" and "to" as YYYYMMDD, or "days" days before and after
+  // today.
+  conf.clear_year();
+  conf.clear_month();
+  int date;
+  if (parseDate(request().get("from"), &date)) {
+    conf.set_first_event_date(date);
+  }
+  if (parseDate(request().get("to"), &date)) {
+    conf.set_last_event_date(date);
+  }
+  const auto& days = request().get("days");
+  if (!days.empty()) {
+    // In UTC, like the X-WR-TIMEZONE of the calendar.
+    int today = time(nullptr) / (24 * 60 * 60);
+    int window = std::min(std::max(atoi(days.c_str()), 0), kMaxWindowDays);
+    conf.set_first_event_date(yyyymmdd_from_days(today - window));
+    conf.set_last_event_date(yyyymmdd_from_days(today + window));
+  }
+  serve(conf, [conf](ResponseSink* body) {
+    Calendar calendar(conf);
+    return calendar.iCalendar(ResponseSink::Write, body);
+  });
+}
+
+void CalendarApp::serveDailyReading(int date)
+{
+  response().set_header("Content-Type", "application/json; charset=utf-8");
+
+  config::CalendarConfig conf;
+  if (!buildConfig(&conf)) {
+    return;
+  }
+  Calendar calendar(conf);
+  std::string json;
+  json.reserve(512);
+  int status = calendar.dailyReadingJson(date, &json);
   if (status != 200) {
     response().status(status);
+    return;
+  }
+  response().out().write(json.data(), json.size());
+}
+
+// The reading of today in UTC, for widgets and bots.
+void CalendarApp::today()
+{
+  const time_t now = time(nullptr);
+  const int seconds_per_day = 24 * 60 * 60;
+  // Valid until midnight.
+  response().cache_control("public, max-age=" + std::to_string(
+        std::min<time_t>(seconds_per_day - now % seconds_per_day, 3600)));
+  serveDailyReading(yyyymmdd_from_days(now / seconds_per_day));
+}
+
+// The reading of the YYYYMMDD "date".
+void CalendarApp::day()
+{
+  int date;
+  if (!parseDate(request().get("date"), &date)) {
+    response().status(400);
+    return;
+  }
+  initResponse();
+  serveDailyReading(date);
+}
+
+// Counters of the render cache, for monitoring.
+void CalendarApp::stats()
+{
+  response().cache_control("no-store");
+  response().set_header("Content-Type", "application/json; charset=utf-8");
+
+  RenderCache& cache = RenderCache::Get();
+  char json[192];
+  int length = snprintf(json, sizeof(json),
+      "{\"hits\":%llu,\"misses\":%llu,\"entries\":%zu,\"bytes\":%zu,"
+      "\"capacity_bytes\":%zu}",
+      (unsigned long long) cache.hits(), (unsigned long long) cache.misses(),
+      cache.entries(), cache.size_bytes(), cache.capacity_bytes());
+  response().out().write(json, length);
+}
+
+// Runs |task| once on each thread of |pool|. Every thread holds on to its
+// task until all of them have started, so that no thread takes two.
+void runOnEveryThread(WorkerPool& pool, const std::function<void()>& task)
+{
+  std::mutex mutex;
+  std::condition_variable all_started;
+  int waiting = pool.size();
+  std::vector<std::future<void>> tasks;
+  for (int i = 0; i < pool.size(); ++i) {
+    tasks.push_back(pool.Submit([&]() {
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (--waiting == 0) {
+          all_started.notify_all();
+        } else {
+          all_started.wait(lock, [&]() { return waiting == 0; });
+        }
+      }
+      task();
+    }));
+  }
+  for (auto& done : tasks) {
+    done.get();
+  }
+}
+
+// Renders the body of |conf| with |render| on |pool| into the render cache.
+std::future<int> prerender(WorkerPool& pool,
+    const config::CalendarConfig& conf,
+    std::function<int(ResponseSink*)> render)
+{
+  const std::string key = RenderCache::Key(conf);
+  return pool.Submit([key, render]() {
+    ResponseSink sink;
+    return renderBody(key, render, &sink).status;
+  });
+}
+
+// Fontconfig scans the fonts of the system on first use, and each thread
+// resolves the fonts of its own Pango font map, so the first requests after
+// a start used to be several times slower than the rest. Pays for that
+// before serving, and renders the requests that most visitors make first.
+void warmUp()
+{
+  const auto start = std::chrono::steady_clock::now();
+
+  // The builder page starts plans on the local date of the browser, so
+  // today and the next month are those of every zone it is used from.
+  std::set<int> start_days;
+  for (int offset_hours : kUtcOffsetHours) {
+    const int today = (time(nullptr) + offset_hours * 60 * 60) /
+      (24 * 60 * 60);
+    const CivilDate date = civil_from_days(today);
+    start_days.insert(today);
+    start_days.insert(
+        today - date.day + 1 + days_in_month(date.year, date.month));
+  }
+
+  std::vector<config::CalendarConfig> confs;
+  for (const char* language : kLanguages) {
+    for (const auto& plan : kDefaultPlans) {
+      for (int start : start_days) {
+        std::map<std::string, std::string> query = plan;
+        query["l"] = language;
+        query["s"] = std::to_string(yyyymmdd_from_days(start));
+
+        config::CalendarConfig conf;
+        buildConfig([&query](const std::string& name) {
+          auto it = query.find(name);
+          return it == query.end() ? std::string() : it->second;
+        }, &conf);
+        confs.push_back(conf);
+      }
+    }
+
+    // The fonts depend on the language only.
+    Calendar calendar(confs.back());
+    calendar.loadFonts();
+    auto load_fonts = [&calendar]() { calendar.loadFonts(); };
+    runOnEveryThread(renderPool(), load_fonts);
+    runOnEveryThread(pdfPool(), load_fonts);
+    runOnEveryThread(Calendar::pagePool(), load_fonts);
+  }
+
+  std::vector<std::future<int>> renders;
+  for (const auto& conf : confs) {
+    config::CalendarConfig sprite = conf;
+    setSpriteOptions(&sprite);
+    renders.push_back(prerender(renderPool(), sprite,
+          [sprite](ResponseSink* body) {
+            Calendar calendar(sprite);
+            return calendar.streamSprite(ResponseSink::Write, body);
+          }));
+
+    config::CalendarConfig pdf = conf;
+    setPdfOptions(&pdf);
+    renders.push_back(prerender(pdfPool(), pdf,
+          [pdf](ResponseSink* body) {
+            Calendar calendar(pdf);
+            return calendar.streamPdf(ResponseSink::Write, body);
+          }));
   }
+
+  int failed = 0;
+  for (auto& render : renders) {
+    try {
+      if (render.get() != 200) {
+        ++failed;
+      }
+    } catch (const std::exception& e) {
+      logger->error(e.what());
+      ++failed;
+    }
+  }
+
+  logger->info("Warmed up in {} ms: {} renders, {} failed, {} bytes cached",
+      std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start).count(),
+      renders.size(), failed, RenderCache::Get().size_bytes());
 }
 
 int main(int argc,char ** argv)
@@ -229,6 +829,17 @@ int main(int argc,char ** argv)
   gflags::ParseCommandLineFlags(&argc, &argv, false);
   // spdlog::set_level(spdlog::level::debug);
 
+  if (FLAGS_build_font_cache) {
+    return FontSet::BuildCache() ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+
+  PlanRegistry::Load();
+
+  // Before the service opens its socket, so that no request waits for it.
+  if (FLAGS_warm_up) {
+    warmUp();
+  }
+
   try {
     cppcms::service srv(argc,argv);
     srv.applications_pool().mount(cppcms::applications_factory<CalendarApp>());
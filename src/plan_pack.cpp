@@ -0,0 +1,336 @@
+#include <fcntl.h>
+#include <fstream>
+#include <sstream>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "plan_pack.h"
+#include "reading_plan.h"
+
+#include <config.pb.h>
+
+namespace {
+
+const char kPackMagic[8] = {'B', 'R', 'C', 'P', 'L', 'A', 'N', '\0'};
+const uint32_t kPackVersion = 1;
+
+template <typename Out>
+  void split(const std::string &s, char delim, Out result) {
+    std::istringstream iss(s);
+    std::string item;
+    while (std::getline(iss, item, delim)) {
+      *result++ = item;
+    }
+  }
+
+std::vector<std::string> split(const std::string &s, char delim) {
+  std::vector<std::string> elems;
+  split(s, delim, std::back_inserter(elems));
+  return elems;
+}
+
+uint64_t fnv1a(const char* data, size_t size) {
+  uint64_t hash = 14695981039346656037ULL;
+  for (size_t i = 0; i < size; ++i) {
+    hash ^= (unsigned char) data[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+template <typename T>
+  void append(const std::vector<T>& v, std::string* out) {
+    out->append((const char*) v.data(), v.size() * sizeof(T));
+  }
+
+} // namespace
+
+std::shared_ptr<spdlog::logger> PlanPack::logger_ =
+  spdlog::stdout_color_mt("plan_pack");
+
+PlanPack::~PlanPack()
+{
+  if (mapped_ != nullptr) {
+    munmap(mapped_, mapped_size_);
+  }
+}
+
+std::unique_ptr<PlanPack> PlanPack::Map(const std::string& file_name)
+{
+  int fd = open(file_name.c_str(), O_RDONLY);
+  if (fd < 0) {
+    logger_->error("Cannot open [{}]: {}", file_name, strerror(errno));
+    return nullptr;
+  }
+  struct stat st;
+  if (fstat(fd, &st) < 0) {
+    logger_->error("Cannot stat [{}]: {}", file_name, strerror(errno));
+    close(fd);
+    return nullptr;
+  }
+  void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    logger_->error("Cannot mmap [{}]: {}", file_name, strerror(errno));
+    return nullptr;
+  }
+
+  std::unique_ptr<PlanPack> pack(new PlanPack());
+  pack->mapped_ = data;
+  pack->mapped_size_ = st.st_size;
+  if (!pack->attach((const char*) data, st.st_size)) {
+    logger_->error("[{}] is not a valid plan pack!", file_name);
+    return nullptr;
+  }
+  return pack;
+}
+
+std::unique_ptr<PlanPack> PlanPack::FromBuffer(std::string buffer)
+{
+  std::unique_ptr<PlanPack> pack(new PlanPack());
+  pack->buffer_ = std::move(buffer);
+  if (!pack->attach(pack->buffer_.data(), pack->buffer_.size())) {
+    logger_->error("Invalid plan pack buffer!");
+    return nullptr;
+  }
+  return pack;
+}
+
+bool PlanPack::attach(const char* data, size_t size)
+{
+  if (size < sizeof(PackHeader)) {
+    return false;
+  }
+  header_ = (const PackHeader*) data;
+  if (memcmp(header_->magic, kPackMagic, sizeof(kPackMagic)) != 0 ||
+      header_->version != kPackVersion) {
+    return false;
+  }
+
+  size_t expected_size = sizeof(PackHeader) +
+    header_->plan_count * sizeof(PackPlan) +
+    header_->day_count * sizeof(PackDay) +
+    header_->unit_count * sizeof(PackUnit) +
+    (header_->string_count + 1) * sizeof(uint32_t) +
+    header_->string_bytes;
+  if (size != expected_size) {
+    return false;
+  }
+  if (fnv1a(data + sizeof(PackHeader), size - sizeof(PackHeader)) !=
+      header_->checksum) {
+    return false;
+  }
+
+  const char* p = data + sizeof(PackHeader);
+  plans_ = (const PackPlan*) p;
+  p += header_->plan_count * sizeof(PackPlan);
+  days_ = (const PackDay*) p;
+  p += header_->day_count * sizeof(PackDay);
+  units_ = (const PackUnit*) p;
+  p += header_->unit_count * sizeof(PackUnit);
+  string_offsets_ = (const uint32_t*) p;
+  p += (header_->string_count + 1) * sizeof(uint32_t);
+  string_data_ = p;
+  return isConsistent();
+}
+
+bool PlanPack::isConsistent() const
+{
+  for (uint32_t i = 0; i < header_->plan_count; ++i) {
+    if ((uint64_t) plans_[i].first_day + plans_[i].day_count >
+        header_->day_count) {
+      logger_->error("Plan {} has days out of range", i);
+      return false;
+    }
+  }
+  for (uint32_t i = 0; i < header_->day_count; ++i) {
+    if ((uint64_t) days_[i].first_unit + days_[i].unit_count >
+        header_->unit_count) {
+      logger_->error("Day {} has units out of range", i);
+      return false;
+    }
+  }
+  for (uint32_t i = 0; i < header_->unit_count; ++i) {
+    const PackUnit& unit = units_[i];
+    for (uint16_t id : {unit.from_book, unit.from_chapter, unit.from_verse,
+        unit.to_book, unit.to_chapter, unit.to_verse}) {
+      if (id >= header_->string_count) {
+        logger_->error("Unit {} has string id {} out of range", i, id);
+        return false;
+      }
+    }
+  }
+  if (header_->string_count == 0 || string_offsets_[0] != 0 ||
+      string_offsets_[header_->string_count] != header_->string_bytes) {
+    logger_->error("String offsets do not span the string data");
+    return false;
+  }
+  for (uint32_t i = 0; i < header_->string_count; ++i) {
+    if (string_offsets_[i] > string_offsets_[i + 1]) {
+      logger_->error("String offsets are not in order at {}", i);
+      return false;
+    }
+  }
+  return true;
+}
+
+std::shared_ptr<spdlog::logger> PlanPackWriter::logger_ =
+  spdlog::stdout_color_mt("plan_pack_writer");
+
+PlanPackWriter::PlanPackWriter()
+{
+  internString("");
+}
+
+int PlanPackWriter::AddPlanFiles()
+{
+  int plans = 0;
+  for (int c = config::CoverageType_MIN; c <= config::CoverageType_MAX; ++c) {
+    for (int d = config::DurationType_MIN; d <= config::DurationType_MAX;
+        ++d) {
+      int years = d == config::DurationType::TWO_YEARS ? 2 : 1;
+      for (int year_index = 0; year_index < years; ++year_index) {
+        // A year has 52 full weeks plus one or two days, read on 5, 6 or
+        // 7 days a week.
+        for (int days_per_week = 5; days_per_week <= 7; ++days_per_week) {
+          for (int extra_days = 0; extra_days <= 2; ++extra_days) {
+            PlanKey key = {
+              static_cast<config::CoverageType>(c),
+              static_cast<config::DurationType>(d),
+              year_index,
+              52 * days_per_week + extra_days};
+            if (addPlanFile(key, PlanRegistry::getPlanFileName(key))) {
+              ++plans;
+            }
+          }
+        }
+      }
+    }
+  }
+  return plans;
+}
+
+bool PlanPackWriter::addPlanFile(const PlanKey& key,
+    const std::string& file_name)
+{
+  std::ifstream infile(file_name);
+  if (!infile) {
+    return false;
+  }
+  logger_->debug(file_name);
+
+  PackPlan plan = {};
+  plan.coverage_type = key.coverage_type;
+  plan.duration_type = key.duration_type;
+  plan.year_index = key.year_index;
+  plan.days = key.days;
+  plan.first_day = days_.size();
+
+  std::string line;
+  while (std::getline(infile, line)) {
+    auto tokens = split(line, ',');
+    PackDay day = {};
+    day.first_unit = units_.size();
+    for (size_t i = 1; i < tokens.size(); i += 6) {
+      PackUnit unit = {};
+
+      unit.from_book = internString(tokens[i]);
+      unit.from_chapter = internString(tokens[i + 1]);
+      unit.from_verse = internString(tokens[i + 2]);
+
+      unit.to_book = internString(tokens[i + 3]);
+      if (i + 4 < tokens.size()) {
+        unit.to_chapter = internString(tokens[i + 4]);
+      }
+      if (i + 5 < tokens.size()) {
+        unit.to_verse = internString(tokens[i + 5]);
+      }
+
+      units_.push_back(unit);
+      ++day.unit_count;
+    }
+    days_.push_back(day);
+  }
+  plan.day_count = days_.size() - plan.first_day;
+  plans_.push_back(plan);
+  return true;
+}
+
+uint16_t PlanPackWriter::internString(const std::string& s)
+{
+  auto it = string_ids_.find(s);
+  if (it != string_ids_.end()) {
+    return it->second;
+  }
+  if (strings_.size() > UINT16_MAX) {
+    if (!too_many_strings_) {
+      logger_->error("More than {} distinct strings in the plans!",
+          UINT16_MAX + 1);
+      too_many_strings_ = true;
+    }
+    return 0;
+  }
+  uint16_t id = strings_.size();
+  strings_.push_back(s);
+  string_ids_.emplace(s, id);
+  return id;
+}
+
+std::string PlanPackWriter::Serialize() const
+{
+  if (too_many_strings_) {
+    return std::string();
+  }
+  std::vector<uint32_t> string_offsets;
+  std::string string_data;
+  for (const auto& s : strings_) {
+    string_offsets.push_back(string_data.size());
+    string_data += s;
+  }
+  string_offsets.push_back(string_data.size());
+
+  std::string body;
+  append(plans_, &body);
+  append(days_, &body);
+  append(units_, &body);
+  append(string_offsets, &body);
+  body += string_data;
+
+  PackHeader header = {};
+  memcpy(header.magic, kPackMagic, sizeof(kPackMagic));
+  header.version = kPackVersion;
+  header.plan_count = plans_.size();
+  header.day_count = days_.size();
+  header.unit_count = units_.size();
+  header.string_count = strings_.size();
+  header.string_bytes = string_data.size();
+  header.checksum = fnv1a(body.data(), body.size());
+
+  std::string pack((const char*) &header, sizeof(header));
+  pack += body;
+  return pack;
+}
+
+bool PlanPackWriter::Write(const std::string& file_name) const
+{
+  std::string pack = Serialize();
+  if (pack.empty()) {
+    return false;
+  }
+  std::ofstream outfile(file_name, std::ios::binary);
+  if (!outfile) {
+    logger_->error("Cannot open [{}]!", file_name);
+    return false;
+  }
+  outfile.write(pack.data(), pack.size());
+  if (!outfile) {
+    logger_->error("Cannot write [{}]!", file_name);
+    return false;
+  }
+  logger_->info("Wrote {} plans, {} days, {} units, {} strings to [{}]",
+      plans_.size(), days_.size(), units_.size(), strings_.size(),
+      file_name);
+  return true;
+}
@@ -0,0 +1,139 @@
+#ifndef PLAN_PACK_H_
+#define PLAN_PACK_H_
+
+#include <memory>
+#include <spdlog/spdlog.h>
+#include <spdlog/sinks/stdout_color_sinks.h>
+#include <stdint.h>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+struct PlanKey;
+
+// On-disk layout of bible-reading-plans.pack, compiled from the plan CSVs by
+// the plan-pack tool at build time. Integers are in host byte order; the pack
+// is rebuilt along with the binaries that read it.
+//
+//   PackHeader
+//   PackPlan[plan_count]      plan directory, sorted by PlanKey
+//   PackDay[day_count]        all days of all plans, back to back
+//   PackUnit[unit_count]      all reading units of all days, back to back
+//   uint32_t[string_count+1]  offsets of each string into the string data
+//   char[string_bytes]        string data, not NUL-terminated
+//
+// String id 0 is always the empty string.
+struct PackHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t plan_count;
+  uint32_t day_count;
+  uint32_t unit_count;
+  uint32_t string_count;
+  uint32_t string_bytes;
+  // FNV-1a hash of everything after the header.
+  uint64_t checksum;
+};
+
+struct PackPlan {
+  uint8_t coverage_type;
+  uint8_t duration_type;
+  uint8_t year_index;
+  uint8_t reserved;
+  uint32_t days;
+  uint32_t first_day;
+  uint32_t day_count;
+};
+
+struct PackDay {
+  uint32_t first_unit;
+  uint32_t unit_count;
+};
+
+struct PackUnit {
+  uint16_t from_book;
+  uint16_t from_chapter;
+  uint16_t from_verse;
+
+  uint16_t to_book;
+  uint16_t to_chapter;
+  uint16_t to_verse;
+};
+
+// A read-only view of a plan pack, either mmap'ed from a file or compiled in
+// memory from the plan CSVs.
+class PlanPack {
+  public:
+    ~PlanPack();
+
+    static std::unique_ptr<PlanPack> Map(const std::string& file_name);
+    static std::unique_ptr<PlanPack> FromBuffer(std::string buffer);
+
+    uint32_t plan_count() const { return header_->plan_count; }
+    uint64_t checksum() const { return header_->checksum; }
+
+    const PackPlan& plan(uint32_t i) const { return plans_[i]; }
+    const PackDay& day(uint32_t i) const { return days_[i]; }
+    const PackUnit& unit(uint32_t i) const { return units_[i]; }
+
+    std::string_view string(uint16_t id) const {
+      return std::string_view(string_data_ + string_offsets_[id],
+          string_offsets_[id + 1] - string_offsets_[id]);
+    }
+
+  private:
+    PlanPack() {}
+
+    bool attach(const char* data, size_t size);
+    // Whether every plan, day, unit and string offset points inside the
+    // pack, so that a pack with a valid checksum cannot be read out of
+    // bounds.
+    bool isConsistent() const;
+
+    static std::shared_ptr<spdlog::logger> logger_;
+
+    // Set when the pack is mmap'ed.
+    void* mapped_ = nullptr;
+    size_t mapped_size_ = 0;
+    // Set when the pack is compiled in memory.
+    std::string buffer_;
+
+    const PackHeader* header_ = nullptr;
+    const PackPlan* plans_ = nullptr;
+    const PackDay* days_ = nullptr;
+    const PackUnit* units_ = nullptr;
+    const uint32_t* string_offsets_ = nullptr;
+    const char* string_data_ = nullptr;
+};
+
+class PlanPackWriter {
+  public:
+    PlanPackWriter();
+
+    // Adds every plan file found under --bible_reading_plans_path and returns
+    // the number of plans added.
+    int AddPlanFiles();
+
+    // The pack, or an empty string if the strings do not fit the 16-bit ids
+    // of PackUnit.
+    std::string Serialize() const;
+    bool Write(const std::string& file_name) const;
+
+  private:
+    bool addPlanFile(const PlanKey& key, const std::string& file_name);
+    uint16_t internString(const std::string& s);
+
+    static std::shared_ptr<spdlog::logger> logger_;
+
+    std::vector<PackPlan> plans_;
+    std::vector<PackDay> days_;
+    std::vector<PackUnit> units_;
+    std::vector<std::string> strings_;
+    std::unordered_map<std::string, uint16_t> string_ids_;
+    // Set once the strings no longer fit the 16-bit ids of PackUnit, after
+    // which the pack must not be written.
+    bool too_many_strings_ = false;
+};
+
+#endif  // PLAN_PACK_H_
@@ -0,0 +1,25 @@
+#include <gflags/gflags.h>
+#include <spdlog/spdlog.h>
+#include <spdlog/sinks/stdout_color_sinks.h>
+
+#include "plan_pack.h"
+
+DEFINE_string(output, "bible-reading-plans.pack",
+    "A path to write the compiled plan pack to.");
+
+auto console = spdlog::stdout_color_mt("main");
+
+int main(int argc, char *argv[])
+{
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+  PlanPackWriter writer;
+  if (writer.AddPlanFiles() == 0) {
+    console->error("No plan files found");
+    return EXIT_FAILURE;
+  }
+  if (!writer.Write(FLAGS_output)) {
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,164 @@
+#include <gflags/gflags.h>
+#include <png.h>
+#include <setjmp.h>
+#include <vector>
+#include <zlib.h>
+
+#include "png_encoder.h"
+
+DEFINE_string(png_color, "gray",
+    "Color type of PNG output: rgba (as written by cairo), gray or gray4.");
+DEFINE_int32(png_compression_level, 6,
+    "zlib compression level of PNG output, from 0 to 9.");
+DEFINE_string(png_filter, "default",
+    "Row filter of PNG output: default (chosen by libpng), none, sub, up, "
+    "average, paeth or all.");
+DEFINE_string(png_strategy, "rle",
+    "zlib strategy of PNG output: default, filtered, rle or huffman.");
+
+std::shared_ptr<spdlog::logger> PngEncoder::logger_ =
+  spdlog::stdout_color_mt("png_encoder");
+
+namespace {
+
+struct WriteContext {
+  cairo_write_func_t write_func;
+  void* closure;
+  cairo_status_t status;
+};
+
+void write_data(png_structp png, png_bytep data, png_size_t length)
+{
+  WriteContext* context = (WriteContext*) png_get_io_ptr(png);
+  if (context->status == CAIRO_STATUS_SUCCESS) {
+    context->status = context->write_func(context->closure, data, length);
+  }
+  if (context->status != CAIRO_STATUS_SUCCESS) {
+    png_error(png, "Write error");
+  }
+}
+
+void flush_data(png_structp png)
+{
+}
+
+int get_filter()
+{
+  if (FLAGS_png_filter == "none") return PNG_FILTER_NONE;
+  if (FLAGS_png_filter == "sub") return PNG_FILTER_SUB;
+  if (FLAGS_png_filter == "up") return PNG_FILTER_UP;
+  if (FLAGS_png_filter == "average") return PNG_FILTER_AVG;
+  if (FLAGS_png_filter == "paeth") return PNG_FILTER_PAETH;
+  if (FLAGS_png_filter == "all") return PNG_ALL_FILTERS;
+  return -1;
+}
+
+int get_strategy()
+{
+  if (FLAGS_png_strategy == "filtered") return Z_FILTERED;
+  if (FLAGS_png_strategy == "rle") return Z_RLE;
+  if (FLAGS_png_strategy == "huffman") return Z_HUFFMAN_ONLY;
+  return Z_DEFAULT_STRATEGY;
+}
+
+} // namespace
+
+cairo_status_t PngEncoder::Write(cairo_surface_t* surface,
+    cairo_write_func_t write_func, void* closure)
+{
+  if (FLAGS_png_color == "gray") {
+    return writeGray(surface, 8, write_func, closure);
+  }
+  if (FLAGS_png_color == "gray4") {
+    return writeGray(surface, 4, write_func, closure);
+  }
+  return cairo_surface_write_to_png_stream(surface, write_func, closure);
+}
+
+void PngEncoder::toGray(const uint32_t* src, int width, uint8_t* dst)
+{
+  // Branch-free so that it is vectorized. With premultiplied alpha, white
+  // under the pixel adds 255 - alpha to each channel.
+  for (int i = 0; i < width; ++i) {
+    uint32_t p = src[i];
+    uint32_t a = p >> 24;
+    uint32_t r = (p >> 16) & 0xff;
+    uint32_t g = (p >> 8) & 0xff;
+    uint32_t b = p & 0xff;
+    uint32_t y = (r * 77 + g * 150 + b * 29 + 128) >> 8;
+    dst[i] = y + 255 - a;
+  }
+}
+
+void PngEncoder::toGray4(const uint8_t* src, int width, uint8_t* dst)
+{
+  for (int i = 0; i < width / 2; ++i) {
+    uint32_t hi = (src[2 * i] * 15 + 127) / 255;
+    uint32_t lo = (src[2 * i + 1] * 15 + 127) / 255;
+    dst[i] = hi << 4 | lo;
+  }
+  if (width % 2) {
+    dst[width / 2] = (src[width - 1] * 15 + 127) / 255 << 4;
+  }
+}
+
+cairo_status_t PngEncoder::writeGray(cairo_surface_t* surface,
+    int bit_depth, cairo_write_func_t write_func, void* closure)
+{
+  cairo_surface_flush(surface);
+  if (cairo_image_surface_get_format(surface) != CAIRO_FORMAT_ARGB32) {
+    logger_->error("Only ARGB32 surfaces can be written as grayscale");
+    return CAIRO_STATUS_INVALID_FORMAT;
+  }
+  const unsigned char* data = cairo_image_surface_get_data(surface);
+  const int width = cairo_image_surface_get_width(surface);
+  const int height = cairo_image_surface_get_height(surface);
+  const int stride = cairo_image_surface_get_stride(surface);
+
+  // Declared before setjmp(), so that png_error() leaves them intact.
+  std::vector<uint8_t> gray(width);
+  std::vector<uint8_t> packed((width + 1) / 2);
+  WriteContext context = {write_func, closure, CAIRO_STATUS_SUCCESS};
+
+  png_structp png = png_create_write_struct(
+      PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
+  if (png == nullptr) {
+    return CAIRO_STATUS_NO_MEMORY;
+  }
+  png_infop info = png_create_info_struct(png);
+  if (info == nullptr) {
+    png_destroy_write_struct(&png, nullptr);
+    return CAIRO_STATUS_NO_MEMORY;
+  }
+  if (setjmp(png_jmpbuf(png))) {
+    png_destroy_write_struct(&png, &info);
+    logger_->error("Failed to write PNG");
+    return context.status != CAIRO_STATUS_SUCCESS ?
+      context.status : CAIRO_STATUS_WRITE_ERROR;
+  }
+
+  png_set_write_fn(png, &context, write_data, flush_data);
+  png_set_compression_level(png, FLAGS_png_compression_level);
+  png_set_compression_strategy(png, get_strategy());
+  int filter = get_filter();
+  if (filter >= 0) {
+    png_set_filter(png, PNG_FILTER_TYPE_BASE, filter);
+  }
+  png_set_IHDR(png, info, width, height, bit_depth, PNG_COLOR_TYPE_GRAY,
+      PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_BASE);
+  png_write_info(png, info);
+
+  for (int y = 0; y < height; ++y) {
+    toGray((const uint32_t*) (data + y * stride), width, gray.data());
+    if (bit_depth == 4) {
+      toGray4(gray.data(), width, packed.data());
+      png_write_row(png, packed.data());
+    } else {
+      png_write_row(png, gray.data());
+    }
+  }
+
+  png_write_end(png, info);
+  png_destroy_write_struct(&png, &info);
+  return context.status;
+}
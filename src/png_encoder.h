@@ -0,0 +1,35 @@
+#ifndef PNG_ENCODER_H_
+#define PNG_ENCODER_H_
+
+#include <cairo.h>
+#include <spdlog/spdlog.h>
+#include <spdlog/sinks/stdout_color_sinks.h>
+
+#include <cstdint>
+#include <memory>
+
+// Encodes rendered calendars as PNG. Calendars are black on white, so the
+// ARGB32 surface is reduced to 8-bit or 4-bit grayscale before compression,
+// which makes the image several times smaller and faster to deflate than
+// the RGBA that cairo_surface_write_to_png_stream() writes. The color type,
+// zlib level, filter and strategy are set by the --png_* flags.
+class PngEncoder {
+  public:
+    // Writes the ARGB32 image |surface| to |write_func|, as if composited on
+    // white.
+    static cairo_status_t Write(cairo_surface_t* surface,
+        cairo_write_func_t write_func, void* closure);
+
+  private:
+    // Converts a row of premultiplied ARGB32 pixels to gray levels.
+    static void toGray(const uint32_t* src, int width, uint8_t* dst);
+    // Packs 8-bit gray levels into 4-bit ones, two per byte.
+    static void toGray4(const uint8_t* src, int width, uint8_t* dst);
+
+    static cairo_status_t writeGray(cairo_surface_t* surface, int bit_depth,
+        cairo_write_func_t write_func, void* closure);
+
+    static std::shared_ptr<spdlog::logger> logger_;
+};
+
+#endif  // PNG_ENCODER_H_
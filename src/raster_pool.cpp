@@ -0,0 +1,121 @@
+#include <gflags/gflags.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "raster_pool.h"
+
+DEFINE_uint64(raster_pool_bytes, 64 << 20,
+    "Memory budget of the idle pixel buffers kept for reuse in bytes. "
+    "0 disables the pool.");
+
+namespace {
+
+const size_t kPageSize = 4096;
+
+const cairo_user_data_key_t buffer_key = {};
+
+} // namespace
+
+std::shared_ptr<spdlog::logger> RasterPool::logger_ =
+  spdlog::stdout_color_mt("raster_pool");
+
+RasterPool::RasterPool(size_t capacity_bytes) :
+  capacity_bytes_(capacity_bytes)
+{
+}
+
+RasterPool::~RasterPool()
+{
+  for (auto& it : idle_) {
+    for (Buffer* buffer : it.second) {
+      free(buffer->data);
+      delete buffer;
+    }
+  }
+}
+
+RasterPool& RasterPool::Get()
+{
+  static RasterPool pool(FLAGS_raster_pool_bytes);
+  return pool;
+}
+
+cairo_surface_t* RasterPool::CreateSurface(int width, int height)
+{
+  const int stride = cairo_format_stride_for_width(CAIRO_FORMAT_ARGB32, width);
+  const size_t size = ((size_t) stride * height + kPageSize - 1) /
+    kPageSize * kPageSize;
+
+  Buffer* buffer = acquire({width, height}, size);
+  if (buffer == nullptr) {
+    logger_->error("Failed to allocate {} bytes", size);
+    return cairo_image_surface_create(CAIRO_FORMAT_ARGB32, width, height);
+  }
+
+  cairo_surface_t* surface = cairo_image_surface_create_for_data(
+      buffer->data, CAIRO_FORMAT_ARGB32, width, height, stride);
+  if (cairo_surface_set_user_data(surface, &buffer_key, buffer, release) !=
+      CAIRO_STATUS_SUCCESS) {
+    // |surface| is in an error state and never touches the buffer.
+    release(buffer);
+  }
+  return surface;
+}
+
+size_t RasterPool::idle_bytes()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return idle_bytes_;
+}
+
+void RasterPool::release(void* buffer)
+{
+  ((Buffer*) buffer)->pool->recycle((Buffer*) buffer);
+}
+
+RasterPool::Buffer* RasterPool::acquire(const Dimensions& dimensions,
+    size_t size)
+{
+  Buffer* buffer = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = idle_.find(dimensions);
+    if (it != idle_.end() && !it->second.empty()) {
+      buffer = it->second.back();
+      it->second.pop_back();
+      idle_bytes_ -= buffer->size;
+    }
+  }
+  if (buffer != nullptr) {
+    ++hits_;
+    // Like cairo_image_surface_create(), start out transparent. Clearing
+    // memory that is already mapped is much cheaper than faulting in new
+    // pages.
+    memset(buffer->data, 0, buffer->size);
+    return buffer;
+  }
+  ++misses_;
+
+  void* data = aligned_alloc(kPageSize, size);
+  if (data == nullptr) {
+    return nullptr;
+  }
+  memset(data, 0, size);
+  return new Buffer{this, dimensions, size, (unsigned char*) data};
+}
+
+void RasterPool::recycle(Buffer* buffer)
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (idle_bytes_ + buffer->size <= capacity_bytes_) {
+      idle_bytes_ += buffer->size;
+      idle_[buffer->dimensions].push_back(buffer);
+      logger_->debug("{} bytes idle, {} hits, {} misses",
+          idle_bytes_, hits_.load(), misses_.load());
+      return;
+    }
+  }
+  free(buffer->data);
+  delete buffer;
+}
@@ -0,0 +1,63 @@
+#ifndef RASTER_POOL_H_
+#define RASTER_POOL_H_
+
+#include <atomic>
+#include <cairo.h>
+#include <map>
+#include <mutex>
+#include <spdlog/spdlog.h>
+#include <spdlog/sinks/stdout_color_sinks.h>
+#include <utility>
+#include <vector>
+
+// Page-aligned pixel buffers for ARGB32 image surfaces, kept for reuse by
+// dimensions once their surface is destroyed. Requests mostly come in a few
+// paper sizes and scales, so a warm pool spares each one allocating and
+// faulting in megabytes of fresh memory. Idle buffers are bounded by a byte
+// budget. Safe to use from any thread.
+class RasterPool {
+  public:
+    explicit RasterPool(size_t capacity_bytes);
+    ~RasterPool();
+    RasterPool(const RasterPool&) = delete;
+    RasterPool& operator=(const RasterPool&) = delete;
+
+    // The process-wide pool, bounded by --raster_pool_bytes.
+    static RasterPool& Get();
+
+    // A cleared ARGB32 surface whose buffer goes back to the pool when the
+    // surface is destroyed.
+    cairo_surface_t* CreateSurface(int width, int height);
+
+    uint64_t hits() const { return hits_; }
+    uint64_t misses() const { return misses_; }
+    size_t idle_bytes();
+
+  private:
+    typedef std::pair<int, int> Dimensions;
+
+    struct Buffer {
+      RasterPool* pool;
+      Dimensions dimensions;
+      size_t size;
+      unsigned char* data;
+    };
+
+    static void release(void* buffer);
+
+    Buffer* acquire(const Dimensions& dimensions, size_t size);
+    void recycle(Buffer* buffer);
+
+    static std::shared_ptr<spdlog::logger> logger_;
+
+    const size_t capacity_bytes_;
+
+    std::mutex mutex_;
+    std::map<Dimensions, std::vector<Buffer*>> idle_;
+    size_t idle_bytes_ = 0;
+
+    std::atomic<uint64_t> hits_{0};
+    std::atomic<uint64_t> misses_{0};
+};
+
+#endif  // RASTER_POOL_H_
@@ -0,0 +1,355 @@
+#include <gflags/gflags.h>
+#include <tuple>
+
+#include "reading_plan.h"
+
+DEFINE_string(bible_reading_plans_path,
+    "/usr/local/etc/bible-reading-calendar/bible-reading-plans/",
+    "A path to bible reading plans directory.");
+
+DEFINE_string(bible_reading_plan_pack,
+    "/usr/local/etc/bible-reading-calendar/bible-reading-plans.pack",
+    "A path to the compiled bible reading plan pack. The plan files under "
+    "--bible_reading_plans_path are used if it cannot be opened.");
+
+namespace {
+
+std::string join(const std::vector<std::string>& v,
+    const std::string& delimiter)
+{
+  std::string ret;
+  bool first = true;
+  for (const auto& s : v) {
+    if (first) {
+      first = false;
+    } else {
+      ret += delimiter;
+    }
+    ret += s;
+  }
+  return ret;
+}
+
+} // namespace
+
+std::string ReadingUnit::Print(config::Language language,
+    bool use_full_name) const
+{
+  std::string text;
+  AppendTo(language, use_full_name, &text);
+  return text;
+}
+
+void ReadingUnit::AppendTo(config::Language language, bool use_full_name,
+    std::string* text) const
+{
+  *text += getBookName(from_book, language, use_full_name);
+  *text += ' ';
+  *text += from_chapter;
+
+  if (!from_verse.empty()) {
+    *text += ':';
+    *text += from_verse;
+  }
+
+  if (!to_book.empty()) {
+    *text += '-';
+    if (from_book != to_book) {
+      *text += getBookName(to_book, language, use_full_name);
+      *text += ' ';
+    }
+
+    if (!to_chapter.empty() &&
+        (from_book != to_book ||
+         from_chapter != to_chapter)) {
+      *text += to_chapter;
+    }
+
+    if (!to_verse.empty()) {
+      *text += ':';
+      *text += to_verse;
+    }
+  }
+}
+
+const std::string& ReadingUnit::getBookName(
+    std::string_view book_id, config::Language language, bool use_full_name)
+{
+  static const Book unknown_book;
+  const auto& books = books_.at(language);
+  auto it = books.find(book_id);
+  const auto& book = it == books.end() ? unknown_book : it->second;
+  if (use_full_name) {
+    return book.full_name;
+  } else {
+    return book.short_name;
+  }
+}
+
+const std::map<config::Language, std::map<std::string, Book, std::less<>>>
+ReadingUnit::books_ = {
+  { config::Language::KOREAN,
+    {
+      {"Genesis", {"창", "창세기"}},
+      {"Exodus", {"출", "출애굽기"}},
+      {"Leviticus", {"레", "레위기"}},
+      {"Numbers", {"민", "민수기"}},
+      {"Deuteronomy", {"신", "신명기"}},
+      {"Joshua", {"수", "여호수아"}},
+      {"Judges", {"삿", "사사기"}},
+      {"Ruth", {"룻", "룻기"}},
+      {"1 Samuel", {"삼상", "사무엘상"}},
+      {"2 Samuel", {"삼하", "사무엘하"}},
+      {"1 Kings", {"왕상", "열왕기상"}},
+      {"2 Kings", {"왕하", "열왕기하"}},
+      {"1 Chronicles", {"대상", "역대상"}},
+      {"2 Chronicles", {"대하", "역대하"}},
+      {"Ezra", {"스", "에스라"}},
+      {"Nehemiah", {"느", "느헤미야"}},
+      {"Esther", {"에", "에스더"}},
+      {"Job", {"욥", "욥기"}},
+      {"Psalms", {"시", "시편"}},
+      {"Proverbs", {"잠", "잠언"}},
+      {"Ecclesiastes", {"전", "전도서"}},
+      {"Song of Solomon", {"아", "아가"}},
+      {"Isaiah", {"사", "이사야"}},
+      {"Jeremiah", {"렘", "예레미야"}},
+      {"Lamentations", {"애", "예레미야애가"}},
+      {"Ezekiel", {"겔", "에스겔"}},
+      {"Daniel", {"단", "다니엘"}},
+      {"Hosea", {"호", "호세아"}},
+      {"Joel", {"욜", "요엘"}},
+      {"Amos", {"암", "아모스"}},
+      {"Obadiah", {"옵", "오바댜"}},
+      {"Jonah", {"욘", "요나"}},
+      {"Micah", {"미", "미가"}},
+      {"Nahum", {"나", "나훔"}},
+      {"Habakkuk", {"합", "하박국"}},
+      {"Zephaniah", {"습", "스바냐"}},
+      {"Haggai", {"학", "학개"}},
+      {"Zechariah", {"슥", "스가랴"}},
+      {"Malachi", {"말", "말라기"}},
+      {"Matthew", {"마", "마태복음"}},
+      {"Mark", {"막", "마가복음"}},
+      {"Luke", {"눅", "누가복음"}},
+      {"John", {"요", "요한복음"}},
+      {"Acts", {"행", "사도행전"}},
+      {"Romans", {"롬", "로마서"}},
+      {"1 Corinthians", {"고전", "고린도전서"}},
+      {"2 Corinthians", {"고후", "고린도후서"}},
+      {"Galatians", {"갈", "갈라디아서"}},
+      {"Ephesians", {"엡", "에베소서"}},
+      {"Philippians", {"빌", "빌립보서"}},
+      {"Colossians", {"골", "골로새서"}},
+      {"1 Thessalonians", {"살전", "데살로니가전서"}},
+      {"2 Thessalonians", {"살후", "데살로니가후서"}},
+      {"1 Timothy", {"딤전", "디모데전서"}},
+      {"2 Timothy", {"딤후", "디모데후서"}},
+      {"Titus", {"디", "디도서"}},
+      {"Philemon", {"몬", "빌레몬서"}},
+      {"Hebrews", {"히", "히브리서"}},
+      {"James", {"약", "야고보서"}},
+      {"1 Peter", {"벧전", "베드로전서"}},
+      {"2 Peter", {"벧후", "베드로후서"}},
+      {"1 John", {"요일", "요한일서"}},
+      {"2 John", {"요이", "요한이서"}},
+      {"3 John", {"요삼", "요한삼서"}},
+      {"Jude", {"유", "유다서"}},
+      {"Revelation", {"계", "요한계시록"}}
+    }},
+  { config::Language::ENGLISH,
+    {
+      {"Genesis", {"Gen", "Genesis"}},
+      {"Exodus", {"Ex", "Exodus"}},
+      {"Leviticus", {"Lev", "Leviticus"}},
+      {"Numbers", {"Num", "Numbers"}},
+      {"Deuteronomy", {"Deut", "Deuteronomy"}},
+      {"Joshua", {"Josh", "Joshua"}},
+      {"Judges", {"Judg", "Judges"}},
+      {"Ruth", {"Ruth", "Ruth"}},
+      {"1 Samuel", {"1 Sam", "1 Samuel"}},
+      {"2 Samuel", {"2 Sam", "2 Samuel"}},
+      {"1 Kings", {"1 Ki", "1 Kings"}},
+      {"2 Kings", {"2 Ki", "2 Kings"}},
+      {"1 Chronicles", {"1 Chr", "1 Chronicles"}},
+      {"2 Chronicles", {"2 Chr", "2 Chronicles"}},
+      {"Ezra", {"Ezra", "Ezra"}},
+      {"Nehemiah", {"Neh", "Nehemiah"}},
+      {"Esther", {"Est", "Esther"}},
+      {"Job", {"Job", "Job"}},
+      {"Psalms", {"Ps", "Psalms"}},
+      {"Proverbs", {"Prov", "Proverbs"}},
+      {"Ecclesiastes", {"Eccles", "Ecclesiastes"}},
+      {"Song of Solomon", {"Song", "Song of Solomon"}},
+      {"Isaiah", {"Isa", "Isaiah"}},
+      {"Jeremiah", {"Jer", "Jeremiah"}},
+      {"Lamentations", {"Lam", "Lamentations"}},
+      {"Ezekiel", {"Ezek", "Ezekiel"}},
+      {"Daniel", {"Dan", "Daniel"}},
+      {"Hosea", {"Hosea", "Hosea"}},
+      {"Joel", {"Joel", "Joel"}},
+      {"Amos", {"Amos", "Amos"}},
+      {"Obadiah", {"Obad", "Obadiah"}},
+      {"Jonah", {"Jonah", "Jonah"}},
+      {"Micah", {"Micah", "Micah"}},
+      {"Nahum", {"Nahum", "Nahum"}},
+      {"Habakkuk", {"Hab", "Habakkuk"}},
+      {"Zephaniah", {"Zeph", "Zephaniah"}},
+      {"Haggai", {"Hag", "Haggai"}},
+      {"Zechariah", {"Zech", "Zechariah"}},
+      {"Malachi", {"Mal", "Malachi"}},
+      {"Matthew", {"Matt", "Matthew"}},
+      {"Mark", {"Mark", "Mark"}},
+      {"Luke", {"Lu", "Luke"}},
+      {"John", {"John", "John"}},
+      {"Acts", {"Acts", "Acts"}},
+      {"Romans", {"Rom", "Romans"}},
+      {"1 Corinthians", {"1 Cor", "1 Corinthians"}},
+      {"2 Corinthians", {"2 Cor", "2 Corinthians"}},
+      {"Galatians", {"Gal", "Galatians"}},
+      {"Ephesians", {"Eph", "Ephesians"}},
+      {"Philippians", {"Phil", "Philippians"}},
+      {"Colossians", {"Col", "Colossians"}},
+      {"1 Thessalonians", {"1 Thess", "1 Thessalonians"}},
+      {"2 Thessalonians", {"2 Thess", "2 Thessalonians"}},
+      {"1 Timothy", {"1 Tim", "1 Timothy"}},
+      {"2 Timothy", {"2 Tim", "2 Timothy"}},
+      {"Titus", {"Titus", "Titus"}},
+      {"Philemon", {"Philem", "Philemon"}},
+      {"Hebrews", {"Heb", "Hebrews"}},
+      {"James", {"James", "James"}},
+      {"1 Peter", {"1 Peter", "1 Peter"}},
+      {"2 Peter", {"2 Peter", "2 Peter"}},
+      {"1 John", {"1 John", "1 John"}},
+      {"2 John", {"2 John", "2 John"}},
+      {"3 John", {"3 John", "3 John"}},
+      {"Jude", {"Jude", "Jude"}},
+      {"Revelation", {"Rev", "Revelation"}}
+    }},
+};
+
+std::string DailyReading::PrintShort(config::Language language) const
+{
+  std::string text;
+  AppendTo(language, false, "\n", &text);
+  return text;
+}
+
+void DailyReading::AppendTo(config::Language language, bool use_full_name,
+    const char* delimiter, std::string* text) const
+{
+  for (uint32_t i = 0; i < unit_count_; ++i) {
+    if (i > 0) {
+      *text += delimiter;
+    }
+    ReadingUnit(*pack_, pack_->unit(first_unit_ + i)).AppendTo(
+        language, use_full_name, text);
+  }
+}
+
+bool PlanKey::operator<(const PlanKey& other) const
+{
+  return std::tie(coverage_type, duration_type, year_index, days) <
+    std::tie(other.coverage_type, other.duration_type, other.year_index,
+        other.days);
+}
+
+std::shared_ptr<spdlog::logger> PlanRegistry::logger_ =
+  spdlog::stdout_color_mt("reading_plan");
+
+std::unique_ptr<const PlanRegistry> PlanRegistry::instance_;
+
+void PlanRegistry::Load()
+{
+  std::unique_ptr<PlanRegistry> registry(new PlanRegistry());
+
+  registry->pack_ = PlanPack::Map(FLAGS_bible_reading_plan_pack);
+  if (registry->pack_) {
+    logger_->info("Mapped plan pack [{}]", FLAGS_bible_reading_plan_pack);
+  } else {
+    PlanPackWriter writer;
+    int plans = writer.AddPlanFiles();
+    logger_->info("Compiled {} plan files from [{}]",
+        plans, FLAGS_bible_reading_plans_path);
+    registry->pack_ = PlanPack::FromBuffer(writer.Serialize());
+    if (!registry->pack_) {
+      instance_ = std::move(registry);
+      return;
+    }
+  }
+
+  const PlanPack& pack = *registry->pack_;
+  for (uint32_t i = 0; i < pack.plan_count(); ++i) {
+    const PackPlan& plan = pack.plan(i);
+    PlanKey key = {
+      static_cast<config::CoverageType>(plan.coverage_type),
+      static_cast<config::DurationType>(plan.duration_type),
+      plan.year_index,
+      static_cast<int>(plan.days)};
+    registry->plans_[key] = &plan;
+  }
+  logger_->info("Loaded {} reading plans", registry->plans_.size());
+  instance_ = std::move(registry);
+}
+
+const PlanRegistry& PlanRegistry::Get()
+{
+  static const PlanRegistry empty;
+  if (!instance_) {
+    logger_->error("PlanRegistry::Load() has not been called!");
+    return empty;
+  }
+  return *instance_;
+}
+
+std::string PlanRegistry::getPlanFileName(const PlanKey& key)
+{
+  std::vector<std::string> file_name_tokens;
+  switch (key.coverage_type) {
+    case config::CoverageType::NEW_TESTAMENT:
+      file_name_tokens.push_back("new-testament");
+      break;
+    case config::CoverageType::OLD_TESTAMENT:
+      file_name_tokens.push_back("old-testament");
+      break;
+    case config::CoverageType::NEW_TESTAMENT_AND_PSALMS:
+      file_name_tokens.push_back("new-testament-and-psalms");
+      break;
+    case config::CoverageType::WHOLE_BIBLE:
+      file_name_tokens.push_back("whole-bible");
+      break;
+    case config::CoverageType::WHOLE_BIBLE_NEW_TESTAMENT_FIRST:
+      file_name_tokens.push_back("whole-bible-new-testament-first");
+      break;
+    case config::CoverageType::WHOLE_BIBLE_IN_PARALLEL:
+      file_name_tokens.push_back("whole-bible-in-parallel");
+      break;
+    default:
+      logger_->error("Unknown CoverageType: {}", key.coverage_type);
+  }
+
+  switch (key.duration_type) {
+    case config::DurationType::ONE_YEAR:
+      file_name_tokens.push_back("1-year");
+      break;
+    case config::DurationType::TWO_YEARS:
+      if (key.year_index == 0) {
+        file_name_tokens.push_back("2-years-1st");
+      } else {
+        file_name_tokens.push_back("2-years-2nd");
+      }
+      break;
+  };
+  file_name_tokens.push_back(std::to_string(key.days));
+  return FLAGS_bible_reading_plans_path +
+    join(file_name_tokens, "_") + ".csv";
+}
+
+const PackPlan* PlanRegistry::Find(const PlanKey& key) const
+{
+  auto it = plans_.find(key);
+  if (it == plans_.end()) {
+    return nullptr;
+  }
+  return it->second;
+}
@@ -0,0 +1,166 @@
+#ifndef READING_PLAN_H_
+#define READING_PLAN_H_
+
+#include <algorithm>
+#include <array>
+#include <map>
+#include <memory>
+#include <spdlog/spdlog.h>
+#include <spdlog/sinks/stdout_color_sinks.h>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <config.pb.h>
+
+#include "plan_pack.h"
+
+struct Book {
+  std::string short_name;
+  std::string full_name;
+};
+
+// A view of one PackUnit. Cheap to construct on the stack.
+class ReadingUnit {
+  public:
+    ReadingUnit(const PlanPack& pack, const PackUnit& unit) :
+      from_book(pack.string(unit.from_book)),
+      from_chapter(pack.string(unit.from_chapter)),
+      from_verse(pack.string(unit.from_verse)),
+      to_book(pack.string(unit.to_book)),
+      to_chapter(pack.string(unit.to_chapter)),
+      to_verse(pack.string(unit.to_verse)) {}
+
+    std::string Print(config::Language language, bool use_full_name) const;
+    void AppendTo(config::Language language, bool use_full_name,
+        std::string* text) const;
+
+    std::string_view from_book;
+    std::string_view from_chapter;
+    std::string_view from_verse;
+
+    std::string_view to_book;
+    std::string_view to_chapter;
+    std::string_view to_verse;
+
+  private:
+    static const std::string& getBookName(
+        std::string_view book_id, config::Language language,
+        bool use_full_name);
+
+    static const std::map<config::Language,
+           std::map<std::string, Book, std::less<>>> books_;
+};
+
+// A view of the reading units of one day, i.e. a span of PackUnits.
+class DailyReading {
+  public:
+    DailyReading(const PlanPack* pack, const PackDay& day) :
+      pack_(pack), first_unit_(day.first_unit),
+      unit_count_(day.unit_count) {}
+
+    // One unit per line, with abbreviated book names.
+    std::string PrintShort(config::Language language) const;
+
+    uint32_t size() const { return unit_count_; }
+    ReadingUnit unit(uint32_t i) const {
+      return ReadingUnit(*pack_, pack_->unit(first_unit_ + i));
+    }
+
+    // Appends the units separated by |delimiter| to |text|.
+    void AppendTo(config::Language language, bool use_full_name,
+        const char* delimiter, std::string* text) const;
+
+  private:
+
+    const PlanPack* pack_;
+    uint32_t first_unit_;
+    uint32_t unit_count_;
+};
+
+// A read-only cursor over the days of one or two plans owned by PlanRegistry.
+class ReadingPlan {
+  public:
+    explicit ReadingPlan(const PlanPack* pack) : pack_(pack) {
+    }
+
+    void Append(const PackPlan& plan) {
+      segments_[segment_count_++] = {plan.first_day, plan.day_count};
+      size_ += plan.day_count;
+    }
+
+    DailyReading PopFront() {
+      return DailyReading(pack_, pack_->day(dayIndex(cursor_++)));
+    }
+
+    void Skip(uint32_t days) {
+      cursor_ = std::min(cursor_ + days, size_);
+    }
+
+    bool empty() const { return cursor_ >= size_; }
+
+  private:
+    // A TWO_YEARS plan is made of the plans for its 1st and 2nd years.
+    static const int kMaxSegments = 2;
+
+    struct Segment {
+      uint32_t first_day;
+      uint32_t day_count;
+    };
+
+    uint32_t dayIndex(uint32_t i) const {
+      int s = 0;
+      while (i >= segments_[s].day_count) {
+        i -= segments_[s++].day_count;
+      }
+      return segments_[s].first_day + i;
+    }
+
+    const PlanPack* pack_;
+    std::array<Segment, kMaxSegments> segments_;
+    int segment_count_ = 0;
+    uint32_t size_ = 0;
+    uint32_t cursor_ = 0;
+};
+
+struct PlanKey {
+  config::CoverageType coverage_type;
+  config::DurationType duration_type;
+  // 0 for the 1st year of the plan, 1 for the 2nd year of a TWO_YEARS plan.
+  int year_index;
+  // Number of reading days in the year, i.e. the suffix of the file name.
+  int days;
+
+  bool operator<(const PlanKey& other) const;
+};
+
+// Every reading plan, loaded once at startup from the plan pack at
+// --bible_reading_plan_pack, or compiled in memory from the CSVs under
+// --bible_reading_plans_path if there is no pack. The registry is immutable
+// after Load() so all request threads can share it.
+class PlanRegistry {
+  public:
+    static void Load();
+    static const PlanRegistry& Get();
+
+    static std::string getPlanFileName(const PlanKey& key);
+
+    // Returns nullptr if there is no plan file for |key|.
+    const PackPlan* Find(const PlanKey& key) const;
+
+    const PlanPack* pack() const { return pack_.get(); }
+
+    // Changes whenever the plan data changes.
+    uint64_t version() const { return pack_ ? pack_->checksum() : 0; }
+
+  private:
+    PlanRegistry() {}
+
+    static std::shared_ptr<spdlog::logger> logger_;
+    static std::unique_ptr<const PlanRegistry> instance_;
+
+    std::unique_ptr<PlanPack> pack_;
+    std::map<PlanKey, const PackPlan*> plans_;
+};
+
+#endif  // READING_PLAN_H_
@@ -0,0 +1,92 @@
+#include <gflags/gflags.h>
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
+
+#include "render_cache.h"
+
+DEFINE_uint64(render_cache_bytes, 256 << 20,
+    "Memory budget of the rendered image and calendar cache in bytes. "
+    "0 disables the cache.");
+
+std::shared_ptr<spdlog::logger> RenderCache::logger_ =
+  spdlog::stdout_color_mt("render_cache");
+
+RenderCache::RenderCache(size_t capacity_bytes) :
+  capacity_bytes_(capacity_bytes)
+{
+}
+
+RenderCache& RenderCache::Get()
+{
+  static RenderCache cache(FLAGS_render_cache_bytes);
+  return cache;
+}
+
+std::string RenderCache::Key(const config::CalendarConfig& conf)
+{
+  std::string key;
+  {
+    google::protobuf::io::StringOutputStream output(&key);
+    google::protobuf::io::CodedOutputStream coded_output(&output);
+    coded_output.SetSerializationDeterministic(true);
+    conf.SerializeToCodedStream(&coded_output);
+  }
+  return key;
+}
+
+std::shared_ptr<const std::string> RenderCache::Find(const std::string& key)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = index_.find(key);
+  if (it == index_.end()) {
+    ++misses_;
+    return nullptr;
+  }
+  ++hits_;
+  entries_.splice(entries_.begin(), entries_, it->second);
+  return it->second->body;
+}
+
+void RenderCache::Insert(const std::string& key,
+    std::shared_ptr<const std::string> body)
+{
+  if (body->size() > capacity_bytes_) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = index_.find(key);
+  if (it != index_.end()) {
+    // Rendered concurrently by another request.
+    entries_.splice(entries_.begin(), entries_, it->second);
+    return;
+  }
+  size_bytes_ += body->size();
+  entries_.push_front({key, std::move(body)});
+  index_.emplace(key, entries_.begin());
+  evict();
+}
+
+size_t RenderCache::entries()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return index_.size();
+}
+
+size_t RenderCache::size_bytes()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return size_bytes_;
+}
+
+void RenderCache::evict()
+{
+  while (size_bytes_ > capacity_bytes_) {
+    const Entry& entry = entries_.back();
+    size_bytes_ -= entry.body->size();
+    index_.erase(entry.key);
+    entries_.pop_back();
+  }
+  logger_->debug("{} entries, {} bytes, {} hits, {} misses",
+      entries_.size(), size_bytes_, hits_.load(), misses_.load());
+}
@@ -0,0 +1,62 @@
+#ifndef RENDER_CACHE_H_
+#define RENDER_CACHE_H_
+
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <spdlog/spdlog.h>
+#include <spdlog/sinks/stdout_color_sinks.h>
+#include <string>
+#include <unordered_map>
+
+#include <config.pb.h>
+
+// Finished response bodies keyed by the canonical serialization of the
+// CalendarConfig they were rendered from, evicted in LRU order once their
+// total size exceeds the byte budget. Safe to use from any thread.
+class RenderCache {
+  public:
+    explicit RenderCache(size_t capacity_bytes);
+
+    // The process-wide cache, sized by --render_cache_bytes.
+    static RenderCache& Get();
+
+    // Deterministic serialization of |conf|. Equal configs, and only equal
+    // configs, have equal keys.
+    static std::string Key(const config::CalendarConfig& conf);
+
+    // Returns nullptr on a miss.
+    std::shared_ptr<const std::string> Find(const std::string& key);
+    void Insert(const std::string& key,
+        std::shared_ptr<const std::string> body);
+
+    size_t capacity_bytes() const { return capacity_bytes_; }
+    uint64_t hits() const { return hits_; }
+    uint64_t misses() const { return misses_; }
+    size_t entries();
+    size_t size_bytes();
+
+  private:
+    struct Entry {
+      std::string key;
+      std::shared_ptr<const std::string> body;
+    };
+
+    void evict();
+
+    static std::shared_ptr<spdlog::logger> logger_;
+
+    const size_t capacity_bytes_;
+
+    std::mutex mutex_;
+    // Most recently used first.
+    std::list<Entry> entries_;
+    std::unordered_map<std::string, std::list<Entry>::iterator> index_;
+    size_t size_bytes_ = 0;
+
+    std::atomic<uint64_t> hits_{0};
+    std::atomic<uint64_t> misses_{0};
+};
+
+#endif  // RENDER_CACHE_H_
@@ -0,0 +1,202 @@
+#include <atomic>
+#include <fcntl.h>
+#include <fstream>
+#include <functional>
+#include <gflags/gflags.h>
+#include <google/protobuf/io/zero_copy_stream_impl.h>
+#include <google/protobuf/text_format.h>
+#include <spdlog/spdlog.h>
+#include <spdlog/sinks/stdout_color_sinks.h>
+#include <sstream>
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+
+#include "calendar.h"
+#include "config.pb.h"
+#include "reading_plan.h"
+#include "response_sink.h"
+
+// Renders every output type of the configs on many threads at once, from
+// Calendars shared by all threads and from Calendars of each thread, and
+// checks that every body is byte for byte the one rendered on the calling
+// thread alone.
+
+DEFINE_string(configs, "config_en.txt,config_ko.txt",
+    "Comma-separated calendar configs to render, in text format.");
+DEFINE_int32(threads, 8, "Number of threads rendering at once.");
+DEFINE_int32(iterations, 2, "Number of times each thread renders each job.");
+DEFINE_string(digests, "",
+    "If set, writes a digest of each body rendered on the calling thread to "
+    "this file, to compare renders across processes with other flags, such "
+    "as --pdf_render_threads=0.");
+
+auto console = spdlog::stdout_color_mt("main");
+
+typedef std::function<int(const Calendar&, ResponseSink*)> Render;
+
+struct Job {
+  std::string name;
+  config::CalendarConfig conf;
+  Render render;
+};
+
+bool parse_config(const std::string& file_name, config::CalendarConfig* conf)
+{
+  int fd = open(file_name.c_str(), O_RDONLY);
+  if (fd < 0) {
+    console->error("Cannot open [{}]: {}", file_name, strerror(errno));
+    return false;
+  }
+  google::protobuf::io::FileInputStream fileInput(fd);
+  fileInput.SetCloseOnDelete(true);
+  return google::protobuf::TextFormat::Parse(&fileInput, conf);
+}
+
+// A month as SVG and PNG, and the whole plan as PDF and sprite, for one
+// config. Events are left out: their DTSTAMP is the time of the render.
+void add_jobs(const std::string& name, config::CalendarConfig conf,
+    std::vector<Job>* jobs)
+{
+  conf.set_start_year(2021);
+  conf.set_start_month(3);
+  conf.set_start_day(15);
+  conf.set_year(2021);
+  conf.set_month(4);
+
+  config::CalendarConfig svg = conf;
+  svg.set_output_type(config::OutputType::SVG);
+  jobs->push_back({name + " svg", svg,
+      [](const Calendar& calendar, ResponseSink* body) {
+        return calendar.streamSvg(ResponseSink::Write, body);
+      }});
+
+  config::CalendarConfig png = conf;
+  png.set_output_type(config::OutputType::PNG);
+  jobs->push_back({name + " png", png,
+      [](const Calendar& calendar, ResponseSink* body) {
+        return calendar.streamPng(ResponseSink::Write, body);
+      }});
+
+  conf.clear_year();
+  conf.clear_month();
+
+  config::CalendarConfig pdf = conf;
+  pdf.set_output_type(config::OutputType::PDF);
+  jobs->push_back({name + " pdf", pdf,
+      [](const Calendar& calendar, ResponseSink* body) {
+        return calendar.streamPdf(ResponseSink::Write, body);
+      }});
+
+  config::CalendarConfig sprite = conf;
+  sprite.set_output_type(config::OutputType::PNG);
+  sprite.set_sprite_columns(4);
+  sprite.set_scale(0.25);
+  jobs->push_back({name + " sprite", sprite,
+      [](const Calendar& calendar, ResponseSink* body) {
+        return calendar.streamSprite(ResponseSink::Write, body);
+      }});
+}
+
+std::string render(const Job& job, const Calendar& calendar)
+{
+  ResponseSink sink;
+  int status = job.render(calendar, &sink);
+  if (status != 200) {
+    console->error("{}: {}", job.name, status);
+    return std::string();
+  }
+  return sink.Release();
+}
+
+uint64_t fnv1a(const std::string& data)
+{
+  uint64_t hash = 14695981039346656037ULL;
+  for (char c : data) {
+    hash ^= (unsigned char) c;
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+// Renders every job FLAGS_iterations times on each of FLAGS_threads threads,
+// each thread starting at a different job, and returns the number of bodies
+// that differ from |expected|.
+int run_threads(const std::vector<Job>& jobs,
+    const std::vector<std::string>& expected,
+    const std::function<std::string(int job)>& render_job)
+{
+  std::atomic<int> mismatches{0};
+  std::vector<std::thread> threads;
+  for (int t = 0; t < FLAGS_threads; ++t) {
+    threads.emplace_back([&, t]() {
+      for (int i = 0; i < FLAGS_iterations; ++i) {
+        for (size_t j = 0; j < jobs.size(); ++j) {
+          int job = (t + j) % jobs.size();
+          if (render_job(job) != expected[job]) {
+            console->error("{} differs on thread {}", jobs[job].name, t);
+            ++mismatches;
+          }
+        }
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  return mismatches;
+}
+
+int main(int argc, char *argv[])
+{
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  PlanRegistry::Load();
+
+  std::vector<Job> jobs;
+  std::istringstream configs(FLAGS_configs);
+  std::string file_name;
+  while (std::getline(configs, file_name, ',')) {
+    config::CalendarConfig conf;
+    if (!parse_config(file_name, &conf)) {
+      console->error("Config parsing error in [{}]", file_name);
+      return EXIT_FAILURE;
+    }
+    add_jobs(file_name, conf, &jobs);
+  }
+
+  std::vector<std::unique_ptr<Calendar>> calendars;
+  std::vector<std::string> expected;
+  for (const auto& job : jobs) {
+    calendars.emplace_back(new Calendar(job.conf));
+    expected.push_back(render(job, *calendars.back()));
+    if (expected.back().empty()) {
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (!FLAGS_digests.empty()) {
+    std::ofstream digests(FLAGS_digests);
+    for (size_t i = 0; i < jobs.size(); ++i) {
+      char digest[20];
+      snprintf(digest, sizeof(digest), "%016llx",
+          (unsigned long long) fnv1a(expected[i]));
+      digests << jobs[i].name << ' ' << expected[i].size() << ' ' << digest <<
+        std::endl;
+    }
+  }
+
+  int shared = run_threads(jobs, expected, [&](int job) {
+    return render(jobs[job], *calendars[job]);
+  });
+  console->info("Shared Calendars: {} of {} bodies differ", shared,
+      FLAGS_threads * FLAGS_iterations * jobs.size());
+
+  int separate = run_threads(jobs, expected, [&](int job) {
+    Calendar calendar(jobs[job].conf);
+    return render(jobs[job], calendar);
+  });
+  console->info("Separate Calendars: {} of {} bodies differ", separate,
+      FLAGS_threads * FLAGS_iterations * jobs.size());
+
+  return shared == 0 && separate == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,95 @@
+#include <algorithm>
+
+#include "response_sink.h"
+
+namespace {
+
+// Chunks double in size from the first one up to the largest, so a small
+// SVG takes one allocation and a PDF of megabytes a dozen.
+const size_t kFirstChunkBytes = 16 << 10;
+const size_t kMaxChunkBytes = 1 << 20;
+
+} // namespace
+
+ResponseSink::ResponseSink(std::ostream* ostream, size_t flush_bytes) :
+  ostream_(ostream), flush_bytes_(flush_bytes)
+{
+}
+
+cairo_status_t ResponseSink::Write(void* closure,
+    const unsigned char* data, unsigned int length)
+{
+  ((ResponseSink*) closure)->Append((const char*) data, length);
+  return CAIRO_STATUS_SUCCESS;
+}
+
+void ResponseSink::Append(const char* data, size_t length)
+{
+  size_ += length;
+  pending_bytes_ += length;
+  while (length > 0) {
+    if (chunks_.empty() ||
+        chunks_.back().data.size() == chunks_.back().capacity) {
+      addChunk(length);
+    }
+    Chunk& chunk = chunks_.back();
+    size_t n = std::min(length, chunk.capacity - chunk.data.size());
+    chunk.data.append(data, n);
+    data += n;
+    length -= n;
+  }
+
+  if (streaming() && pending_bytes_ >= flush_bytes_) {
+    Flush();
+  }
+}
+
+void ResponseSink::Flush()
+{
+  if (!streaming() || pending_bytes_ == 0) {
+    return;
+  }
+  for (; flushed_chunk_ < chunks_.size(); ++flushed_chunk_) {
+    const Chunk& chunk = chunks_[flushed_chunk_];
+    ostream_->write(chunk.data.data() + flushed_offset_,
+        chunk.data.size() - flushed_offset_);
+    flushed_offset_ = chunk.data.size();
+    if (chunk.data.size() < chunk.capacity) {
+      // The last chunk, still being filled.
+      break;
+    }
+    flushed_offset_ = 0;
+  }
+  ostream_->flush();
+  pending_bytes_ = 0;
+}
+
+std::string ResponseSink::Release()
+{
+  std::string body;
+  // Unless most of its capacity would be held on to by the cache.
+  if (chunks_.size() == 1 && size_ >= chunks_.front().capacity / 2) {
+    body = std::move(chunks_.front().data);
+  } else {
+    body.reserve(size_);
+    for (auto& chunk : chunks_) {
+      body += chunk.data;
+      std::string().swap(chunk.data);
+    }
+  }
+  chunks_.clear();
+  size_ = 0;
+  flushed_chunk_ = 0;
+  flushed_offset_ = 0;
+  pending_bytes_ = 0;
+  return body;
+}
+
+void ResponseSink::addChunk(size_t min_capacity)
+{
+  size_t capacity = chunks_.empty() ? kFirstChunkBytes :
+    std::min(chunks_.back().capacity * 2, kMaxChunkBytes);
+  capacity = std::max(capacity, std::min(min_capacity, kMaxChunkBytes));
+  chunks_.push_back({std::string(), capacity});
+  chunks_.back().data.reserve(capacity);
+}
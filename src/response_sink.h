@@ -0,0 +1,60 @@
+#ifndef RESPONSE_SINK_H_
+#define RESPONSE_SINK_H_
+
+#include <cairo.h>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Collects a response body in a growing list of chunks, so that appending
+// never moves what is already written. The whole body is kept, so it can be
+// measured for Content-Length and cached. In streaming mode it is also
+// written to an ostream, and flushed, once enough of it is pending.
+class ResponseSink {
+  public:
+    // Unless |ostream| is null, also streams the body to it in writes of at
+    // least |flush_bytes|, except for the last one.
+    explicit ResponseSink(std::ostream* ostream = nullptr,
+        size_t flush_bytes = 0);
+    ResponseSink(const ResponseSink&) = delete;
+    ResponseSink& operator=(const ResponseSink&) = delete;
+
+    // A cairo_write_func_t appending to the ResponseSink in |closure|.
+    static cairo_status_t Write(void* closure,
+        const unsigned char* data, unsigned int length);
+
+    void Append(const char* data, size_t length);
+    void Append(const std::string& data) { Append(data.data(), data.size()); }
+
+    // Streams what is still pending, if streaming.
+    void Flush();
+
+    // The whole body in one piece, as it is cached and written, leaving the
+    // sink empty. A body that fills most of one chunk is moved out without a
+    // copy; otherwise every chunk is freed as soon as it is copied.
+    std::string Release();
+
+    size_t size() const { return size_; }
+    bool streaming() const { return ostream_ != nullptr; }
+
+  private:
+    struct Chunk {
+      // Reserved to |capacity| and never grown past it, so it is not moved.
+      std::string data;
+      size_t capacity;
+    };
+
+    void addChunk(size_t min_capacity);
+
+    std::vector<Chunk> chunks_;
+    size_t size_ = 0;
+
+    std::ostream* const ostream_;
+    const size_t flush_bytes_;
+    // The chunk and the offset in it that are not streamed yet.
+    size_t flushed_chunk_ = 0;
+    size_t flushed_offset_ = 0;
+    size_t pending_bytes_ = 0;
+};
+
+#endif  // RESPONSE_SINK_H_
@@ -0,0 +1,68 @@
+#include <future>
+
+#include "single_flight.h"
+
+std::shared_ptr<spdlog::logger> SingleFlight::logger_ =
+  spdlog::stdout_color_mt("single_flight");
+
+SingleFlight& SingleFlight::Get()
+{
+  static SingleFlight single_flight;
+  return single_flight;
+}
+
+bool SingleFlight::Join(const std::string& key, Callback done)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = in_flight_.find(key);
+  if (it == in_flight_.end()) {
+    in_flight_[key].push_back(std::move(done));
+    return true;
+  }
+  it->second.push_back(std::move(done));
+  ++coalesced_;
+  logger_->debug("Joined a render in flight, {} coalesced",
+      coalesced_.load());
+  return false;
+}
+
+void SingleFlight::Land(const std::string& key, const Result& result)
+{
+  std::vector<Callback> waiting;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = in_flight_.find(key);
+    if (it == in_flight_.end()) {
+      return;
+    }
+    waiting = std::move(it->second);
+    in_flight_.erase(it);
+  }
+  for (const auto& done : waiting) {
+    done(result);
+  }
+}
+
+SingleFlight::Result SingleFlight::Do(const std::string& key,
+    const std::function<Result()>& render, bool* leader)
+{
+  std::promise<Result> promise;
+  std::future<Result> future = promise.get_future();
+  *leader = Join(key, [&promise](const Result& result) {
+    promise.set_value(result);
+  });
+  if (!*leader) {
+    return future.get();
+  }
+
+  Result result = {500, nullptr};
+  try {
+    result = render();
+  } catch (...) {
+    // Callers that joined get an error, rather than waiting forever.
+    Land(key, result);
+    throw;
+  }
+  Land(key, result);
+  return result;
+}
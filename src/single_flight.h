@@ -0,0 +1,58 @@
+#ifndef SINGLE_FLIGHT_H_
+#define SINGLE_FLIGHT_H_
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <spdlog/spdlog.h>
+#include <spdlog/sinks/stdout_color_sinks.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Coalesces concurrent renders of the same key: the first caller renders,
+// and callers arriving while it runs share its result instead of rendering
+// the same bytes again. Safe to use from any thread.
+class SingleFlight {
+  public:
+    struct Result {
+      int status;
+      // Set if |status| is 200.
+      std::shared_ptr<const std::string> body;
+    };
+
+    typedef std::function<void(const Result&)> Callback;
+
+    // The process-wide instance.
+    static SingleFlight& Get();
+
+    // Has |done| called with the result of the render of |key|. Returns true
+    // if no render of |key| was in flight, in which case the caller must
+    // render it and pass the result to Land(). Otherwise |done| just joins
+    // the render in flight, without holding up the caller.
+    bool Join(const std::string& key, Callback done);
+    // Ends the render of |key| started by Join(), calling every |done| that
+    // joined it on this thread.
+    void Land(const std::string& key, const Result& result);
+
+    // Returns the result of |render|, run by this call or by the one
+    // already in flight for |key|, waiting for it. |leader| tells which. If
+    // |render| throws, the exception propagates here and callers that
+    // joined get status 500.
+    Result Do(const std::string& key, const std::function<Result()>& render,
+        bool* leader);
+
+    uint64_t coalesced() const { return coalesced_; }
+
+  private:
+    static std::shared_ptr<spdlog::logger> logger_;
+
+    std::mutex mutex_;
+    // The callbacks waiting for each render in flight.
+    std::unordered_map<std::string, std::vector<Callback>> in_flight_;
+
+    std::atomic<uint64_t> coalesced_{0};
+};
+
+#endif  // SINGLE_FLIGHT_H_
@@ -0,0 +1,87 @@
+#include <gflags/gflags.h>
+
+#include "font_set.h"
+#include "text_cache.h"
+
+DEFINE_uint64(text_cache_entries, 4096,
+    "Maximum number of shaped text layouts cached per rendering thread.");
+
+TextCache& TextCache::Get()
+{
+  thread_local TextCache cache(FLAGS_text_cache_entries);
+  return cache;
+}
+
+TextCache::TextCache(size_t capacity) : capacity_(capacity)
+{
+  // Before the first layout of this thread.
+  FontSet::UseOnThisThread();
+}
+
+TextCache::~TextCache()
+{
+  for (auto& entry : entries_) {
+    g_object_unref(entry.shaped_text.layout);
+  }
+}
+
+const TextCache::ShapedText& TextCache::Shape(cairo_t* cr,
+    const std::string& font_key, const PangoFontDescription* font,
+    config::Language language, PangoAlignment alignment,
+    const char* text)
+{
+  std::string key = font_key;
+  key += '\x1f';
+  key += std::to_string(language);
+  key += '\x1f';
+  key += std::to_string(alignment);
+  key += '\x1f';
+  // Font options, and so shaping, differ between raster and vector targets.
+  key += std::to_string(cairo_surface_get_type(cairo_get_target(cr)));
+  key += '\x1f';
+  // So do the font options of a fast render.
+  cairo_font_options_t* font_options = cairo_font_options_create();
+  cairo_get_font_options(cr, font_options);
+  key += std::to_string(cairo_font_options_hash(font_options));
+  cairo_font_options_destroy(font_options);
+  key += '\x1f';
+  key += text;
+
+  auto it = index_.find(key);
+  if (it != index_.end()) {
+    ++hits_;
+    entries_.splice(entries_.begin(), entries_, it->second);
+    ShapedText& shaped_text = it->second->shaped_text;
+    // Re-shapes only if the transformation or font options of |cr| differ,
+    // otherwise the size below is already computed.
+    pango_cairo_update_layout(cr, shaped_text.layout);
+    measure(&shaped_text);
+    return shaped_text;
+  }
+  ++misses_;
+
+  while (!entries_.empty() && entries_.size() >= capacity_) {
+    g_object_unref(entries_.back().shaped_text.layout);
+    index_.erase(entries_.back().key);
+    entries_.pop_back();
+  }
+
+  PangoLayout* layout = pango_cairo_create_layout(cr);
+  pango_layout_set_font_description(layout, font);
+  pango_layout_set_alignment(layout, alignment);
+  pango_layout_set_text(layout, text, -1);
+
+  entries_.push_front({key, {layout, 0, 0}});
+  index_.emplace(std::move(key), entries_.begin());
+  ShapedText& shaped_text = entries_.front().shaped_text;
+  measure(&shaped_text);
+  return shaped_text;
+}
+
+void TextCache::measure(ShapedText* shaped_text)
+{
+  int width, height;
+  pango_layout_get_size(shaped_text->layout, &width, &height);
+  shaped_text->width = (double) width / PANGO_SCALE;
+  shaped_text->height = (double) height / PANGO_SCALE;
+}
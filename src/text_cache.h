@@ -0,0 +1,65 @@
+#ifndef TEXT_CACHE_H_
+#define TEXT_CACHE_H_
+
+#include <cairo.h>
+#include <list>
+#include <pango/pangocairo.h>
+#include <string>
+#include <unordered_map>
+
+#include <config.pb.h>
+
+// Shaped PangoLayouts and their sizes, keyed by font, language, alignment,
+// target surface type, font options and text. Day numbers, weekday names, month labels and
+// the plan of a given day recur across requests, so after warm-up drawing
+// text only positions an already shaped layout.
+//
+// Pango objects must stay on the thread that created them (the default
+// PangoCairo font map is per thread), so each thread has its own cache.
+class TextCache {
+  public:
+    struct ShapedText {
+      PangoLayout* layout;
+      // In user-space units.
+      double width;
+      double height;
+    };
+
+    // The cache of the calling thread, bounded by --text_cache_entries.
+    static TextCache& Get();
+
+    explicit TextCache(size_t capacity);
+    ~TextCache();
+    TextCache(const TextCache&) = delete;
+    TextCache& operator=(const TextCache&) = delete;
+
+    // |font_key| identifies |font|, e.g. its pango_font_description_to_string.
+    // The returned layout is ready to be shown on |cr| and stays valid until
+    // the next call.
+    const ShapedText& Shape(cairo_t* cr,
+        const std::string& font_key, const PangoFontDescription* font,
+        config::Language language, PangoAlignment alignment,
+        const char* text);
+
+    uint64_t hits() const { return hits_; }
+    uint64_t misses() const { return misses_; }
+
+  private:
+    struct Entry {
+      std::string key;
+      ShapedText shaped_text;
+    };
+
+    static void measure(ShapedText* shaped_text);
+
+    const size_t capacity_;
+
+    // Most recently used first.
+    std::list<Entry> entries_;
+    std::unordered_map<std::string, std::list<Entry>::iterator> index_;
+
+    uint64_t hits_ = 0;
+    uint64_t misses_ = 0;
+};
+
+#endif  // TEXT_CACHE_H_
@@ -0,0 +1,55 @@
+#ifndef WORKER_POOL_H_
+#define WORKER_POOL_H_
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed set of long-lived threads running submitted tasks in FIFO order.
+// The threads live as long as the pool, so their thread_local caches
+// (TextCache, the frame cache, the Pango font map) stay warm across requests.
+// A pool of 0 threads runs each task on the submitting thread.
+class WorkerPool {
+  public:
+    explicit WorkerPool(int threads);
+    ~WorkerPool();
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    template <typename F>
+      auto Submit(F f) -> std::future<decltype(f())> {
+        auto task = std::make_shared<std::packaged_task<decltype(f())()>>(
+            std::move(f));
+        auto future = task->get_future();
+        if (threads_.empty()) {
+          (*task)();
+        } else {
+          Post([task]() { (*task)(); });
+        }
+        return future;
+      }
+
+    // Queues |task| without a way to wait for it. |task| must not throw.
+    void Post(std::function<void()> task);
+
+    int size() const { return threads_.size(); }
+    // Tasks waiting for a thread.
+    size_t queued();
+
+  private:
+    void run();
+
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    std::deque<std::function<void()>> tasks_;
+    bool stopping_ = false;
+
+    std::vector<std::thread> threads_;
+};
+
+#endif  // WORKER_POOL_H_
@@ -52,6 +52,11 @@ export class BuilderComponent implements OnInit {
 
   galleryItems: LightGallery["galleryItems"] = [];
   galleryItemsByYear = new Map();
+  // Identifies the latest preview, which earlier ones must not overwrite.
+  previewGeneration = 0;
+  // Scale of the thumbnails, which are at most 240px wide. See
+  // kScaleTiers in main_cms.cpp.
+  previewScale = 0.5;
 
   pdfUrl = '';
 
@@ -203,43 +208,121 @@ export class BuilderComponent implements OnInit {
       this.galleryItems.length = 0;
       this.galleryItemsByYear.clear();
 
-      let d = this.getStartDate();
+      this.loadPreview(this.getStartDate());
+    } else if (stepper.selectedIndex == stepper.steps.length - 1) {
+      // "Download" is selected
+      // TODO: Remove unnecessary month param.
+      this.pdfUrl = '/cpp/img.pdf?' + this.getUrlParam(this.getStartDate());
+    }
+  }
 
-      let totalMonths = 12;
-      if (this.durationType() === 'two-years') {
-        totalMonths += 12;
-      }
-      if (d.getDate() > 1) {
-        totalMonths += 1;
+  // Shows a thumbnail of every month of the plan, cut out of one sprite so
+  // that the thumbnails cost a single request. The lightbox loads each month
+  // in full size only when it is opened.
+  async loadPreview(startDate: Date) {
+    const generation = ++this.previewGeneration;
+    let thumbnails: string[] = [];
+    try {
+      thumbnails = await this.fetchThumbnails(startDate);
+    } catch (e) {
+      // Each thumbnail is then the full-size month.
+      console.error(e);
+    }
+    if (generation != this.previewGeneration) {
+      // The preview was requested again in the meantime.
+      return;
+    }
+
+    const totalMonths = thumbnails.length || this.countMonths(startDate);
+
+    // In case the date is on 31, adding a month to the date may skip months
+    // which doesn't have 31 days.
+    let d = new Date(startDate.getTime());
+    d.setDate(1);
+
+    for (let i = 0; i < totalMonths; i++) {
+      const url = '/cpp/img.png?' + this.getUrlParam(d);
+      const thumbnail = thumbnails[i] || url;
+
+      this.galleryItems.push({
+        src: url,
+        thumb: thumbnail,
+      });
+
+      if (!this.galleryItemsByYear.has(d.getFullYear())) {
+        this.galleryItemsByYear.set(d.getFullYear(), []);
       }
+      this.galleryItemsByYear.get(d.getFullYear()).push({
+        index: i,
+        src: thumbnail
+      });
 
-      // In case the date is on 31, adding a month to the date may skip months
-      // which doesn't have 31 days.
-      d.setDate(1);
+      d.setMonth(d.getMonth() + 1);
+    }
+    this.lightGallery.refresh(this.galleryItems);
+  }
 
+  // Fetches the sprite of the plan at previewScale and cuts it into one
+  // image per month.
+  async fetchThumbnails(startDate: Date): Promise<string[]> {
+    const response = await fetch('/cpp/sprite.png?' +
+                                 this.getUrlParam(startDate) +
+                                 '&x=' + this.previewScale);
+    if (!response.ok) {
+      throw new Error('sprite.png: ' + response.status);
+    }
+    const columns = Number(response.headers.get('X-Sprite-Columns'));
+    const totalMonths = Number(response.headers.get('X-Sprite-Months'));
+    const sprite = await createImageBitmap(await response.blob());
+
+    const width = sprite.width / Math.min(columns, totalMonths);
+    const height = sprite.height / Math.ceil(totalMonths / columns);
+    const canvas = document.createElement('canvas');
+    canvas.width = width;
+    canvas.height = height;
+    const context = canvas.getContext('2d')!;
+
+    const thumbnails: string[] = [];
+    try {
       for (let i = 0; i < totalMonths; i++) {
-        let url = '/cpp/img.png?' + this.getUrlParam(d);
-
-        this.galleryItems.push({
-          src: url,
-        });
+        context.drawImage(sprite,
+                          (i % columns) * width,
+                          Math.floor(i / columns) * height,
+                          width, height, 0, 0, width, height);
+        thumbnails.push(await this.toDataUrl(canvas));
+      }
+    } finally {
+      sprite.close();
+    }
+    return thumbnails;
+  }
 
-        if (!this.galleryItemsByYear.has(d.getFullYear())) {
-          this.galleryItemsByYear.set(d.getFullYear(), []);
+  // Encodes |canvas| as PNG without blocking the page where the browser can.
+  // Angular 12 sanitizes blob: URLs away, but keeps data: images.
+  toDataUrl(canvas: HTMLCanvasElement): Promise<string> {
+    return new Promise((resolve, reject) => {
+      canvas.toBlob(blob => {
+        if (!blob) {
+          reject(new Error('Cannot encode a thumbnail'));
+          return;
         }
-        this.galleryItemsByYear.get(d.getFullYear()).push({
-          index: i,
-          src: url
-        });
+        const reader = new FileReader();
+        reader.onload = () => resolve(reader.result as string);
+        reader.onerror = () => reject(reader.error);
+        reader.readAsDataURL(blob);
+      }, 'image/png');
+    });
+  }
 
-        d.setMonth(d.getMonth() + 1);
-      }
-      this.lightGallery.refresh(this.galleryItems);
-    } else if (stepper.selectedIndex == stepper.steps.length - 1) {
-      // "Download" is selected
-      // TODO: Remove unnecessary month param.
-      this.pdfUrl = '/cpp/img.pdf?' + this.getUrlParam(this.getStartDate());
+  countMonths(startDate: Date) {
+    let totalMonths = 12;
+    if (this.durationType() === 'two-years') {
+      totalMonths += 12;
+    }
+    if (startDate.getDate() > 1) {
+      totalMonths += 1;
     }
+    return totalMonths;
   }
 
   getUrlParam(startDate: Date) {